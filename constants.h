@@ -8,11 +8,91 @@ const int error_codes[error_codes_count] = {not_known_error_code, 0, 64, 3187671
 #define len_sqlstate_str    5
 const int excluded_errcodes[] = {ERRCODE_CRASH_SHUTDOWN};
 
+/* Lock and serialization failures tracked by relation and query */
+#define contention_errcodes_count    4
+const int contention_errcodes[contention_errcodes_count] = {ERRCODE_T_R_DEADLOCK_DETECTED, ERRCODE_LOCK_NOT_AVAILABLE,
+                                                            ERRCODE_T_R_SERIALIZATION_FAILURE, ERRCODE_QUERY_CANCELED};
+
+/* Authentication failures tracked by client address */
+#define auth_errcodes_count    2
+const int auth_errcodes[auth_errcodes_count] = {ERRCODE_INVALID_PASSWORD, ERRCODE_INVALID_AUTHORIZATION_SPECIFICATION};
+/* Max count of keys with client address, further messages are counted without it */
+#define max_client_keys    4096
+
+/*
+ * Retry loop detector: size of suspects table, max pause between errors of one
+ * run and age of entry after which its run is over
+ */
+#define max_retry_suspects    64
+#define retry_loop_max_gap_ms    1000
+#define retry_suspect_expire_ms    (5 * retry_loop_max_gap_ms)
+
+/* Max count of databases which transaction counters are sampled each interval */
+#define max_sampled_databases    64
+
+/* Max count of classes and codes in logerrors.urgent_errcodes */
+#define max_urgent_errcodes    32
+
+/* Bloom filter of error keys ever seen (1MB) and ring of recent novel errors */
+#define novelty_filter_bits    (8 * 1024 * 1024)
+#define novelty_filter_hashes    4
+#define novelty_filter_magic    0x4C454E46
+#define max_novel_errors    128
+
+/* Anomaly detector: size of ring of flagged intervals */
+#define max_anomalies    128
+
+/* Slowest statements kept for each interval and length of their stored text */
+#define slow_top_count    10
+#define slow_query_length    256
+
+/* Max size of datagram with interval deltas sent to logerrors.push_socket */
+#define push_datagram_size    8192
+
+/* Sampled counting: max weight of a message counted with probability 1/weight is 2^max_sampling_shift */
+#define max_sampling_shift    10
+
+/* Max count of backends waiting in pg_log_errors_wait() at once */
+#define max_error_waiters    32
+
+/* Classes of statements raising messages, 0 means the statement is not known */
+#define statement_classes_count    5
+#define statement_class_select    1
+#define statement_class_dml    2
+#define statement_class_ddl    3
+#define statement_class_utility    4
+const char statement_class_names[statement_classes_count][10] = {"", "SELECT", "DML", "DDL", "UTILITY"};
+
 #define message_types_count    3
 const char message_type_names[message_types_count][10] = {"WARNING", "ERROR", "FATAL"};
 const int message_types_codes[] = {WARNING, ERROR, FATAL};
 
-#define messages_per_interval	1024
+/*
+ * Types of all messages written to server log, first message_types_count are the same as above.
+ * Last one is not a level, it marks keys of slow statements.
+ */
+#define log_types_count    9
+#define slow_log_type_index    8
+const char log_type_names[log_types_count][10] = {"WARNING", "ERROR", "FATAL", "PANIC", "NOTICE", "INFO", "LOG", "DEBUG",
+                                                  "SLOW"};
+
 #define max_intervals_count 360
-/* +5 because we don't want take lock on MessagesBuffer while pg_log_errors_stats is running */
-#define max_actual_intervals_count	365
+/* Buffer keeps 5 intervals more than configured, see global_variables_init() */
+#define max_actual_intervals_count (max_intervals_count + 5)
+
+/* Keys are interned to dense ids, counters are allocated in DSA by chunks of keys */
+#define keys_per_chunk	256
+#define max_key_chunks	4096
+/* End of free list of key ids */
+#define invalid_key_id	PG_UINT32_MAX
+/* Idle keys are freed when more of max_keys are in use, warning is raised above the second one */
+#define reclaim_keys_percent	75
+#define capacity_warning_percent	90
+/* Approximate dshash cost of one interned key (item header, entry and bucket) */
+#define key_table_overhead	64
+/* Interned names (relations, constraints, ...), id 0 means no name */
+#define name_key_length	(2 * NAMEDATALEN)
+#define names_per_chunk	256
+#define max_name_chunks	256
+/* Size of in-place part of DSA area in main shared memory */
+#define dsa_place_size	(1024 * 1024)
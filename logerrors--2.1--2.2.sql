@@ -0,0 +1,270 @@
+CREATE FUNCTION pg_log_errors_capacity(
+    OUT keys integer,
+    OUT max_keys integer,
+    OUT dropped bigint,
+    OUT reclaimed bigint,
+    OUT warning text
+)
+    RETURNS record
+AS 'MODULE_PATHNAME', 'pg_log_errors_capacity'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_capacity() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_capacity() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_relations(
+    OUT time_interval integer,
+    OUT relation text,
+    OUT constraint_name text,
+    OUT sqlstate text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_relations'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_relations() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_relations() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_locations(
+    OUT time_interval integer,
+    OUT type text,
+    OUT funcname text,
+    OUT filename text,
+    OUT lineno integer,
+    OUT sqlstate text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_locations'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_locations() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_locations() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_contention(
+    OUT time_interval integer,
+    OUT sqlstate text,
+    OUT relation text,
+    OUT queryid bigint,
+    OUT username text,
+    OUT database text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_contention'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_contention() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_contention() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_clients(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT client_addr text,
+    OUT sqlstate text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_clients'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_clients(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_clients(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_suspects(
+    OUT pid integer,
+    OUT username text,
+    OUT database text,
+    OUT queryid bigint,
+    OUT sqlstate text,
+    OUT run_length bigint,
+    OUT last_seen timestamptz
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_suspects'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_suspects() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_suspects() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_db_ratio(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT database text,
+    OUT errors bigint,
+    OUT xact_commit bigint,
+    OUT xact_rollback bigint,
+    OUT error_ratio double precision,
+    OUT rollback_ratio double precision
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_db_ratio'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_db_ratio(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_db_ratio(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_volume(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT type text,
+    OUT database text,
+    OUT sqlstate text,
+    OUT message text,
+    OUT count integer,
+    OUT bytes bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_volume'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_volume(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_volume(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_novel(
+    OUT first_seen timestamptz,
+    OUT type text,
+    OUT sqlstate text,
+    OUT username text,
+    OUT database text,
+    OUT message text
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_novel'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_novel() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_novel() TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_anomalies(
+    OUT detected_at timestamptz,
+    OUT type text,
+    OUT sqlstate text,
+    OUT username text,
+    OUT database text,
+    OUT count integer,
+    OUT mean double precision,
+    OUT stddev double precision,
+    OUT score double precision
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_anomalies'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_log_errors_anomalies() FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_anomalies() TO pg_monitor;
+
+CREATE FUNCTION pg_slow_log_stats(
+    window_seconds integer,
+    OUT time_interval integer,
+    OUT database text,
+    OUT username text,
+    OUT application_name text,
+    OUT queryid bigint,
+    OUT slow_count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_slow_log_stats_window'
+    LANGUAGE C STRICT;
+REVOKE ALL ON FUNCTION pg_slow_log_stats(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_slow_log_stats(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_slow_log_top(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT duration double precision,
+    OUT seen_at timestamptz,
+    OUT database text,
+    OUT username text,
+    OUT queryid bigint,
+    OUT query text
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_slow_log_top'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_slow_log_top(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_slow_log_top(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_wait(
+    threshold integer,
+    timeout integer,
+    code text DEFAULT NULL,
+    OUT type text,
+    OUT sqlstate text,
+    OUT username text,
+    OUT database text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_wait'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_wait(integer, integer, text) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_wait(integer, integer, text) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_ingest(
+    path text,
+    interval_seconds integer DEFAULT 60,
+    format text DEFAULT NULL,
+    OUT "time" timestamptz,
+    OUT type text,
+    OUT sqlstate text,
+    OUT username text,
+    OUT database text,
+    OUT count bigint
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_ingest'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_ingest(text, integer, text) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_ingest(text, integer, text) TO pg_read_server_files;
+
+CREATE FUNCTION pg_log_errors_statements(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT statement_class text,
+    OUT type text,
+    OUT sqlstate text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_statements'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_statements(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_statements(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_plfunctions(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT function_oid oid,
+    OUT function_name text,
+    OUT database text,
+    OUT type text,
+    OUT sqlstate text,
+    OUT count integer
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_plfunctions'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_plfunctions(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_plfunctions(integer) TO pg_monitor;
+
+CREATE FUNCTION pg_log_errors_accuracy(
+    window_seconds integer DEFAULT NULL,
+    OUT time_interval integer,
+    OUT sampled bigint,
+    OUT stddev double precision
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_accuracy'
+    LANGUAGE C;
+REVOKE ALL ON FUNCTION pg_log_errors_accuracy(integer) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION pg_log_errors_accuracy(integer) TO pg_monitor;
+
+ALTER EXTENSION logerrors DROP FUNCTION pg_log_errors_stats();
+DROP FUNCTION IF EXISTS pg_log_errors_stats();
+
+CREATE FUNCTION pg_log_errors_stats(
+    OUT time_interval integer,
+    OUT type text,
+    OUT message text,
+    OUT count integer,
+    OUT username text,
+    OUT database text,
+    OUT sqlstate text,
+    OUT first_seen timestamptz,
+    OUT last_seen timestamptz
+)
+    RETURNS SETOF record
+AS 'MODULE_PATHNAME', 'pg_log_errors_stats'
+    LANGUAGE C STRICT;
@@ -2,37 +2,74 @@
 #include "postgres.h"
 #include "fmgr.h"
 #include "access/xact.h"
+#include "access/xlog.h"
+#include "lib/dshash.h"
 #include "lib/stringinfo.h"
+#include "libpq/libpq-be.h"
 #include "pgstat.h"
 #include "port.h"
 #include "executor/spi.h"
+#include "plpgsql.h"
 #include "postmaster/bgworker.h"
+#include "replication/message.h"
+#include "tcop/pquery.h"
+#include "storage/condition_variable.h"
 #include "storage/fd.h"
 #include "storage/ipc.h"
 #include "storage/latch.h"
 #include "storage/proc.h"
+#include "storage/procarray.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
 #include "utils/guc.h"
 #include "utils/snapmgr.h"
 #include "miscadmin.h"
 #include "utils/memutils.h"
+#include "utils/portal.h"
 #include "utils/hsearch.h"
 #include "utils/builtins.h"
+#include "utils/dsa.h"
+#include "utils/lsyscache.h"
+#include "utils/timestamp.h"
 #include "funcapi.h"
 #include "catalog/pg_authid.h"
+#include "utils/acl.h"
 #include "utils/syscache.h"
 #include "access/htup_details.h"
 #include "time.h"
 #include "commands/dbcommands.h"
+#include "common/ip.h"
 #include "common/string.h"
 #include "common/file_perm.h"
+#include "port/pg_bitutils.h"
+#include "port/pg_bswap.h"
 #include "utils/resowner.h"
 
+#if (PG_VERSION_NUM >= 130000)
+#include "common/hashfn.h"
+#else
+#include "utils/hashutils.h"
+#endif
+
 #include "constants.h"
+#include "logerrors_export.h"
+#include "logerrors_message.h"
+#include "logparse.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* Allow load of this module in shared libs */
 PG_MODULE_MAGIC;
@@ -59,18 +96,70 @@ static char *worker_name = "logerrors";
 
 static emit_log_hook_type prev_emit_log_hook = NULL;
 static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static PLpgSQL_plugin **plpgsql_plugin_var = NULL;
+static PLpgSQL_plugin *prev_plpgsql_plugin = NULL;
+static PLpgSQL_plugin plfunction_plugin;
 #if (PG_VERSION_NUM >= 150000)
 static shmem_request_hook_type prev_shmem_request_hook = NULL;
 static void logerrors_shmem_request(void);
 #endif
 
 static void write_to_stat_file(void);
+static void write_errors_file(int duration_in_intervals);
+static void read_novelty_filter(void);
+static void save_novelty_filter(void);
+static void export_open(void);
+static void export_update(void);
+static void push_open(void);
+static void push_update(void);
+static void publish_interval(void);
+static void write_prometheus_file(void);
+static void handle_urgent_message(void);
+static void reclaim_idle_keys(uint32 keys_count);
 
 char* excluded_errcodes_str = NULL;
+char* urgent_errcodes_str = "53";
+char* urgent_file = NULL;
+/* Memory-mapped file with counters for local collectors, not written by default */
+char* export_file = NULL;
+/* Unix datagram socket receiving deltas of each interval, nothing is sent by default */
+char* push_socket = NULL;
+/* Database bgworker connects to for emitting logical decoding messages, nothing is emitted by default */
+char* publish_database = NULL;
+/* Textfile collector directory of node_exporter, nothing is written by default */
+char* prometheus_directory = NULL;
+int prometheus_interval = 15000;
 char* stats_temp_directory = NULL;
 char* default_stats_temp_directory = "$pgdata/pg_stat_tmp";
 int stats_persistence_interval = 60000;
-
+/* Memory cap for the key table and its counters (kB) */
+static int max_memory = 32 * 1024;
+/* Add relation and constraint of the message to its key */
+static bool track_relations = false;
+/* Add source location (file, line, function) of the message to its key */
+static bool track_locations = false;
+/* Add relation and query to keys of lock and serialization failures */
+static bool track_contention = true;
+/* Add client address to keys of authentication failures */
+static bool track_auth_clients = true;
+/* Count of identical errors in a row making backend a retry loop suspect, 0 disables detector */
+static int retry_loop_threshold = 0;
+/* Warnings and errors per second of one backend above which they are counted by sampling, 0 disables */
+static int sampling_threshold = 0;
+/* Count bytes of all messages written to server log */
+static bool track_volume = false;
+/* Keep times of first and last message of each key in each interval */
+static bool track_times = false;
+/* Count errors by class of statement raising them */
+static bool track_statement_class = false;
+/* Count errors by PL/pgSQL function raising them */
+static bool track_plfunctions = false;
+/* Remember error keys never seen before */
+static bool track_novelty = true;
+/* Flag interval count of key deviating from its mean by that many standard deviations, 0 disables */
+static double anomaly_threshold = 4.0;
+/* Intervals of key before it gets a score */
+static int anomaly_min_samples = 12;
 
 typedef struct error_code {
     int num;
@@ -82,6 +171,25 @@ typedef struct message_info {
     Oid db_oid;
     Oid user_oid;
     int message_type_index;
+    /* Optional dimensions, ids of interned names or 0 */
+    uint32 relation_id;
+    uint32 constraint_id;
+    /* "filename:lineno" and funcname of the code raising the message */
+    uint32 location_id;
+    uint32 funcname_id;
+    /* Client address, for authentication failures only */
+    uint32 client_id;
+    /* Message format, when volume is tracked */
+    uint32 format_id;
+    /* Application name, for slow statements only */
+    uint32 application_id;
+    /* Class of statement, one of statement_class_* or 0 */
+    uint32 statement_class;
+    /* Innermost PL/pgSQL function raising message, name id of its signature and oid */
+    uint32 plfunction_id;
+    Oid plfunction_oid;
+    /* Query id, for lock and serialization failures and slow statements only */
+    uint64 queryid;
 } MessageInfo;
 
 typedef struct error_name {
@@ -89,17 +197,171 @@ typedef struct error_name {
     char* name;
 } ErrorName;
 
+/* Backend repeating the same failing statement */
+typedef struct retry_suspect {
+    int pid;
+    Oid db_oid;
+    Oid user_oid;
+    /* Role backend was started with, to tell it from later backend with the same pid */
+    Oid role_oid;
+    int error_code;
+    uint64 statement_id;
+    uint64 run_length;
+    TimestampTz last_time;
+} RetrySuspect;
+
+/* Transactions of database finished during one interval */
+typedef struct xact_sample {
+    Oid db_oid;
+    int64 xact_commit;
+    int64 xact_rollback;
+} XactSample;
+
+/* Last cumulative counters of database seen by bgworker */
+typedef struct xact_counters {
+    Oid db_oid;
+    int64 xact_commit;
+    int64 xact_rollback;
+} XactCounters;
+
+/* Error key seen for the first time */
+typedef struct novel_error {
+    TimestampTz first_seen;
+    int error_code;
+    Oid db_oid;
+    Oid user_oid;
+    int message_type_index;
+    /* Message format, if volume is tracked */
+    char message[name_key_length];
+} NovelError;
+
+/* Interval count of key far above its decayed mean */
+typedef struct anomaly {
+    TimestampTz detected_at;
+    MessageInfo key;
+    uint32 count;
+    double mean;
+    double stddev;
+    double score;
+} Anomaly;
+
+/* Slow statement kept in top of its interval */
+typedef struct slow_statement {
+    double duration;
+    TimestampTz seen_at;
+    Oid db_oid;
+    Oid user_oid;
+    uint64 queryid;
+    char query[slow_query_length];
+} SlowStatement;
+
+/* Min-heap by duration of the slowest statements of one interval */
+typedef struct slow_top {
+    int count;
+    /* Microseconds of the fastest kept statement when top is full, else 0, read without lock */
+    pg_atomic_uint64 threshold;
+    SlowStatement statements[slow_top_count];
+} SlowTop;
+
+/* Header of novelty filter file, followed by filter words */
+typedef struct novelty_file_header {
+    uint32 magic;
+    uint32 bits;
+    uint32 hashes;
+    uint32 padding;
+} NoveltyFileHeader;
+
 typedef struct slow_log_info {
     pg_atomic_uint32 count;
     pg_atomic_uint64 reset_time;
 } SlowLogInfo;
 
+/* Entry of shared key table, maps message key to its dense id */
+typedef struct key_entry {
+    MessageInfo key;
+    uint32 id;
+} KeyEntry;
+
+/* Counter of projected key in reader functions */
+typedef struct counter_hashelem {
+    MessageInfo key;
+    uint32 counter;
+    /* Smallest id of keys projected to it, output follows it */
+    uint32 first_id;
+    /* First and last message, 0 when times are not tracked */
+    TimestampTz first_seen;
+    TimestampTz last_seen;
+} CounterHashElem;
+
+/* Count and bytes of projected key in pg_log_errors_volume() */
+typedef struct volume_hashelem {
+    MessageInfo key;
+    uint32 counter;
+    uint64 bytes;
+} VolumeHashElem;
+
+/* Keeps only fields shown by reader function, returns false to skip the key */
+typedef bool (*project_key_function)(MessageInfo *key);
+
+typedef struct name_key {
+    char name[name_key_length];
+} NameKey;
+
+/* Entry of shared names table, maps name to its id */
+typedef struct name_entry {
+    NameKey key;
+    uint32 id;
+} NameEntry;
+
+/* Interned keys and their counters for keys_per_chunk consecutive ids, allocated in DSA */
+typedef struct key_chunk {
+    MessageInfo keys[keys_per_chunk];
+    /* Exponentially decayed mean and variance of interval counts, updated by bgworker only */
+    double mean[keys_per_chunk];
+    double variance[keys_per_chunk];
+    uint32 samples[keys_per_chunk];
+    /* Ids freed by reclaim_idle_keys() and the next free id of each */
+    bool is_free[keys_per_chunk];
+    uint32 next_free[keys_per_chunk];
+    /*
+     * counts[interval_index * keys_per_chunk + id % keys_per_chunk], followed by
+     * pg_atomic_uint64 bytes in the same layout when volume is tracked, then by
+     * pg_atomic_uint64 first and last message times when times are tracked
+     */
+    pg_atomic_uint32 counts[FLEXIBLE_ARRAY_MEMBER];
+} KeyChunk;
+
 typedef struct messages_buffer {
+    /* Protects interval rotation and key insertion */
     LWLock lock;
     int current_interval_index;
-    pg_atomic_uint32 current_message_index;
-    /* depends on messages per interval and max intervals count */
-    MessageInfo buffer[messages_per_interval * max_actual_intervals_count];
+    /* Ids below keys_count are interned, their chunks are allocated */
+    pg_atomic_uint32 keys_count;
+    /* Depends on max_memory and intervals count */
+    uint32 max_keys;
+    /* logerrors.track_volume at startup, chunks have bytes counters */
+    bool track_volume;
+    /* logerrors.track_times at startup, chunks have first and last message times */
+    bool track_times;
+    /* Messages not counted because key table is full */
+    pg_atomic_uint64 dropped_count;
+    /* Ids of idle keys freed for reuse and their count, protected by lock */
+    uint32 free_head;
+    uint32 free_count;
+    /* Keys freed since reset */
+    uint64 reclaimed_count;
+    /* Keys in use are above capacity_warning_percent of max_keys even after reclaim */
+    bool capacity_warning;
+    /* Keys with client address, limited by max_client_keys */
+    pg_atomic_uint32 client_keys_count;
+    /* Buckets of key and names tables are grown to their maximum, new keys are dropped before */
+    bool tables_presized;
+    dsa_pointer chunks[max_key_chunks];
+    /* Name with id n is stored at index n - 1 */
+    pg_atomic_uint32 names_count;
+    /* Incremented when names are forgotten, invalidates local caches of name ids */
+    pg_atomic_uint32 names_generation;
+    dsa_pointer name_chunks[max_name_chunks];
 } MessagesBuffer;
 
 /* Depends on message_types_count */
@@ -112,20 +374,137 @@ typedef struct global_info {
     pg_atomic_uint32 total_count[3];
     SlowLogInfo slow_log_info;
     MessagesBuffer messagesBuffer;
-    int excluded_errcodes[error_codes_count];
+    int dsa_tranche_id;
+    dshash_table_handle keys_table_handle;
+    dshash_table_handle names_table_handle;
+    /* int array in DSA */
+    dsa_pointer excluded_errcodes;
     int excluded_errcodes_count;
+    /* Classes (when urgent_is_class) and codes waking up bgworker at once */
+    int urgent_errcodes[max_urgent_errcodes];
+    bool urgent_is_class[max_urgent_errcodes];
+    int urgent_errcodes_count;
+    /* Latch of bgworker, NULL when it is not running */
+    Latch *worker_latch;
+    /* Set by backend on urgent message until bgworker handles it, count of them since */
+    pg_atomic_uint32 urgent_pending;
+    pg_atomic_uint32 urgent_errcode;
+    pg_atomic_uint32 urgent_elevel;
+    pg_atomic_uint32 urgent_count;
+    /* Set while bgworker connects to publish_database, still set after restart if it failed */
+    bool publish_unavailable;
+    /* XactSample[actual_intervals_count][max_sampled_databases] in DSA, allocated by bgworker */
+    dsa_pointer xact_samples;
+    /* Retry loop suspects, entry with pid 0 is free */
+    slock_t suspects_lock;
+    RetrySuspect suspects[max_retry_suspects];
+    /*
+     * Novelty filter words in DSA, allocated by bgworker only with track_novelty,
+     * ring and its next position, protected by messagesBuffer.lock
+     */
+    bool novelty_filter_dirty;
+    dsa_pointer novelty_filter;
+    uint64 novel_errors_next;
+    NovelError novel_errors[max_novel_errors];
+    /* SlowTop[actual_intervals_count] in DSA, allocated by bgworker, protected by slow_top_lock */
+    slock_t slow_top_lock;
+    dsa_pointer slow_top;
+    /* Ring of flagged intervals and its next position, protected by messagesBuffer.lock */
+    uint64 anomalies_next;
+    Anomaly anomalies[max_anomalies];
+    /* Thresholds of backends in pg_log_errors_wait(), 0 is free slot */
+    pg_atomic_uint32 waiters_count;
+    pg_atomic_uint32 wait_thresholds[max_error_waiters];
+    ConditionVariable wait_cv;
+    /* Estimated messages counted by sampling in each interval and variance of that estimate */
+    pg_atomic_uint64 sampled_counts[max_actual_intervals_count];
+    pg_atomic_uint64 sampled_variance[max_actual_intervals_count];
+    /* Ids below fill of interval may have counts in it, readers skip the rest and empty intervals */
+    pg_atomic_uint32 interval_fill[max_actual_intervals_count];
 } GlobalInfo;
 
-typedef struct counter_hashelem {
-    MessageInfo key;
-    int counter;
-} CounterHashElem;
-
 static GlobalInfo *global_variables = NULL;
 
+/* In-place part of DSA area, lives in main shared memory */
+static void *dsa_place = NULL;
+/* Per-backend attachment to DSA area and key table */
+static dsa_area *logerrors_dsa = NULL;
+static dshash_table *keys_table = NULL;
+static dshash_table *names_table = NULL;
+
+static dshash_parameters keys_table_params = {
+    .key_size = sizeof(MessageInfo),
+    .entry_size = sizeof(KeyEntry),
+    .compare_function = dshash_memcmp,
+    .hash_function = dshash_memhash,
+#if (PG_VERSION_NUM >= 170000)
+    .copy_function = dshash_memcpy,
+#endif
+};
+
+static dshash_parameters names_table_params = {
+    .key_size = sizeof(NameKey),
+    .entry_size = sizeof(NameEntry),
+    .compare_function = dshash_memcmp,
+    .hash_function = dshash_memhash,
+#if (PG_VERSION_NUM >= 170000)
+    .copy_function = dshash_memcpy,
+#endif
+};
+
+/*
+ * Backend-local cache of source locations. ErrorData keeps pointers to string
+ * literals, so location is identified by pointers and formatted only once.
+ */
+typedef struct location_key {
+    const char *filename;
+    int lineno;
+    const char *funcname;
+} LocationKey;
+
+typedef struct location_entry {
+    LocationKey key;
+    uint32 location_id;
+    uint32 funcname_id;
+} LocationEntry;
+
+/*
+ * Backend-local cache of message formats. message_id is not always a string
+ * literal (errmsg_internal() of a formatted buffer, strings of extensions), the
+ * same address may hold another format later, so formats are keyed by text.
+ */
+typedef struct format_entry {
+    NameKey key;
+    uint32 format_id;
+} FormatEntry;
+
+static HTAB *locations_cache = NULL;
+static HTAB *formats_cache = NULL;
+static uint32 locations_cache_generation = 0;
+
+/* Cumulative transaction counters of sampled databases, bgworker only */
+static XactCounters last_xact_counters[max_sampled_databases];
+static int last_xact_counters_count = 0;
+
+/* Current run of identical errors in this backend */
+static int retry_run_error_code = 0;
+static uint64 retry_run_statement_id = 0;
+static uint64 retry_run_length = 0;
+static TimestampTz retry_run_last_time = 0;
+static TimestampTz retry_suspect_updated = 0;
+
+/* Messages of this backend in current interval and state of random generator for sampling */
+static int sampling_interval_index = -1;
+static uint32 sampling_messages = 0;
+static uint64 sampling_random = 0;
+
+/* Parsed logerrors.excluded_errcodes, copied to DSA on shmem startup */
+static int *excluded_errcodes_local = NULL;
+
 static HTAB *error_names_hashtable = NULL;
 
-static uint32 last_stats_counter[3] = {0};
+/* Totals of message types and slow statements at last write to stats file */
+static uint32 last_stats_counter[4] = {0};
 
 void logerrors_emit_log_hook(ErrorData *edata);
 
@@ -141,24 +520,105 @@ logerrors_sigterm(SIGNAL_ARGS)
 
 PGDLLEXPORT void logerrors_main(Datum) pg_attribute_noreturn();
 
+static Size
+key_chunk_size(int actual_intervals_count, bool with_bytes, bool with_times)
+{
+    Size size = add_size(offsetof(KeyChunk, counts),
+                         mul_size(sizeof(pg_atomic_uint32), keys_per_chunk * actual_intervals_count));
+    if (with_bytes)
+        size = add_size(size, mul_size(sizeof(pg_atomic_uint64), keys_per_chunk * actual_intervals_count));
+    if (with_times)
+        size = add_size(size, mul_size(2 * sizeof(pg_atomic_uint64), keys_per_chunk * actual_intervals_count));
+    return size;
+}
+
+/* Bytes counters of chunk, valid only when volume is tracked */
+static pg_atomic_uint64*
+get_chunk_bytes(KeyChunk *chunk)
+{
+    return (pg_atomic_uint64 *) &chunk->counts[keys_per_chunk * global_variables->actual_intervals_count];
+}
+
+/* Times of first messages of chunk, valid only when times are tracked */
+static pg_atomic_uint64*
+get_chunk_first_seen(KeyChunk *chunk)
+{
+    if (!global_variables->messagesBuffer.track_volume)
+        return get_chunk_bytes(chunk);
+    return get_chunk_bytes(chunk) + keys_per_chunk * global_variables->actual_intervals_count;
+}
+
+/* Times of last messages of chunk, valid only when times are tracked */
+static pg_atomic_uint64*
+get_chunk_last_seen(KeyChunk *chunk)
+{
+    return get_chunk_first_seen(chunk) + keys_per_chunk * global_variables->actual_intervals_count;
+}
+
+/* Parse logerrors.urgent_errcodes: two-letter classes and five-letter codes separated by ',' */
+static void
+urgent_errcodes_init()
+{
+    int len;
+    char* urgent_errcode_str;
+    char* urgent_errcodes_copy;
+
+    global_variables->urgent_errcodes_count = 0;
+    if (urgent_errcodes_str == NULL)
+        return;
+    urgent_errcodes_copy = pstrdup(urgent_errcodes_str);
+    urgent_errcode_str = strtok(urgent_errcodes_copy, ", ");
+    while (urgent_errcode_str != NULL &&
+           global_variables->urgent_errcodes_count < max_urgent_errcodes) {
+        len = strlen(urgent_errcode_str);
+        if (len != 2 && len != len_sqlstate_str) {
+            elog(WARNING, "logerrors: urgent errcode length should be equal to 2 or %d", len_sqlstate_str);
+            urgent_errcode_str = strtok(NULL, ", ");
+            continue;
+        }
+        global_variables->urgent_is_class[global_variables->urgent_errcodes_count] = (len == 2);
+        global_variables->urgent_errcodes[global_variables->urgent_errcodes_count] =
+                MAKE_SQLSTATE(urgent_errcode_str[0],
+                              urgent_errcode_str[1],
+                              len == 2 ? '0' : urgent_errcode_str[2],
+                              len == 2 ? '0' : urgent_errcode_str[3],
+                              len == 2 ? '0' : urgent_errcode_str[4]);
+        global_variables->urgent_errcodes_count += 1;
+        urgent_errcode_str = strtok(NULL, ", ");
+    }
+    pfree(urgent_errcodes_copy);
+}
+
         static void
         global_variables_init()
 {
     int sqlstate;
     int errcodes_count;
+    uint64 max_keys;
     char* excluded_errcode_str;
     char excluded_errcodes_copy[error_codes_count * (len_sqlstate_str + 1)];
     global_variables->intervals_count = intervals_count;
     /* +5 because we don't want take lock on MessagesBuffer while pg_log_errors_stats is running */
     global_variables->actual_intervals_count = intervals_count + 5;
     global_variables->interval = interval;
+    global_variables->messagesBuffer.track_volume = track_volume;
+    global_variables->messagesBuffer.track_times = track_times;
+
+    /* Each key costs its slot in chunk and its entry in key table */
+    max_keys = (uint64) max_memory * 1024 /
+               (key_chunk_size(global_variables->actual_intervals_count, track_volume, track_times) / keys_per_chunk +
+                key_table_overhead);
+    max_keys -= max_keys % keys_per_chunk;
+    max_keys = Max(max_keys, keys_per_chunk);
+    max_keys = Min(max_keys, (uint64) keys_per_chunk * max_key_chunks);
+    global_variables->messagesBuffer.max_keys = (uint32) max_keys;
 
-    memset(&global_variables->excluded_errcodes, '\0', sizeof(global_variables->excluded_errcodes));
+    excluded_errcodes_local = palloc0(sizeof(int) * error_codes_count);
 
     errcodes_count = sizeof(excluded_errcodes) / sizeof(excluded_errcodes[0]);
     global_variables->excluded_errcodes_count = errcodes_count;
 
-    memcpy(&global_variables->excluded_errcodes[0], excluded_errcodes, sizeof(excluded_errcodes));
+    memcpy(excluded_errcodes_local, excluded_errcodes, sizeof(excluded_errcodes));
     if (excluded_errcodes_str == NULL)
         return;
     memset(&excluded_errcodes_copy, '\0', sizeof(excluded_errcodes_copy));
@@ -177,7 +637,7 @@ PGDLLEXPORT void logerrors_main(Datum) pg_attribute_noreturn();
                                  excluded_errcode_str[3],
                                  excluded_errcode_str[4]);
 
-        global_variables->excluded_errcodes[global_variables->excluded_errcodes_count] = sqlstate;
+        excluded_errcodes_local[global_variables->excluded_errcodes_count] = sqlstate;
         global_variables->excluded_errcodes_count += 1;
         if (global_variables->excluded_errcodes_count == error_codes_count - 1)
             break;
@@ -193,785 +653,5176 @@ slow_log_info_init()
     pg_atomic_init_u64(&global_variables->slow_log_info.reset_time, GetCurrentTimestamp());
 }
 
+/*
+ * Attach current process to DSA area and key table created by postmaster.
+ * Returns false if it is not possible right now.
+ */
+static bool
+logerrors_attach_dsa(void)
+{
+    MemoryContext oldcontext;
+    if (keys_table != NULL)
+        return true;
+    if (global_variables == NULL || dsa_place == NULL || CritSectionCount > 0)
+        return false;
+    LWLockRegisterTranche(global_variables->dsa_tranche_id, "logerrors");
+    oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+    logerrors_dsa = dsa_attach_in_place(dsa_place, NULL);
+    dsa_pin_mapping(logerrors_dsa);
+    keys_table_params.tranche_id = global_variables->dsa_tranche_id;
+    names_table_params.tranche_id = global_variables->dsa_tranche_id;
+    names_table = dshash_attach(logerrors_dsa, &names_table_params, global_variables->names_table_handle, NULL);
+    keys_table = dshash_attach(logerrors_dsa, &keys_table_params, global_variables->keys_table_handle, NULL);
+    MemoryContextSwitchTo(oldcontext);
+    return true;
+}
+
+/*
+ * Upper bound of DSA area: key chunks and key table take max_memory (at least
+ * one chunk), names and other structures have fixed maximums. Placeholders of
+ * presize_tables() are transient, a quarter more is left for them and for
+ * rounding of DSA pages.
+ */
+static size_t
+dsa_size_limit(void)
+{
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    uint64 names = (uint64) names_per_chunk * max_name_chunks;
+    uint64 limit;
+
+    limit = (uint64) (mb->max_keys / keys_per_chunk) *
+            key_chunk_size(global_variables->actual_intervals_count, mb->track_volume, mb->track_times);
+    limit += (uint64) mb->max_keys * (key_table_overhead + 8 * sizeof(dsa_pointer));
+    limit += names * (sizeof(NameKey) + key_table_overhead + 8 * sizeof(dsa_pointer));
+    limit += novelty_filter_bits / 8;
+    limit += (sizeof(SlowTop) + sizeof(XactSample) * max_sampled_databases) * max_actual_intervals_count;
+    limit += limit / 4;
+    return (size_t) (dsa_place_size + limit);
+}
+
+/*
+ * Create DSA area in place and key table in it. Called by postmaster only, all allocations
+ * must fit into in-place segment, new DSM segments can't be created here.
+ */
 static void
-add_message(int err_code, Oid db_oid, Oid user_oid, int message_type_index) {
-    int index_to_write;
-    int current_message;
-    if (global_variables == NULL)
-        return;
-    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
-    current_message = pg_atomic_read_u32(&global_variables->messagesBuffer.current_message_index);
-    index_to_write = global_variables->messagesBuffer.current_interval_index * messages_per_interval
-                     + current_message;
-    if (current_message >= messages_per_interval) {
-        /* too many messages per one interval, save current instead of random message in interval */
-        srand(time(0));
-        index_to_write = global_variables->messagesBuffer.current_interval_index * messages_per_interval +
-                         rand() % messages_per_interval;
-    }
-
-    global_variables->messagesBuffer.buffer[index_to_write].db_oid = db_oid;
-    global_variables->messagesBuffer.buffer[index_to_write].user_oid = user_oid;
-    global_variables->messagesBuffer.buffer[index_to_write].error_code = err_code;
-    global_variables->messagesBuffer.buffer[index_to_write].message_type_index = message_type_index;
-    pg_atomic_write_u32(&global_variables->messagesBuffer.current_message_index, current_message + 1);
-    LWLockRelease(&global_variables->messagesBuffer.lock);
+logerrors_dsa_init(void)
+{
+    dsa_area *area;
+    dshash_table *table;
+    dshash_table *names;
+    int *excluded;
+
+    global_variables->dsa_tranche_id = LWLockNewTrancheId();
+    area = dsa_create_in_place(dsa_place, dsa_place_size, global_variables->dsa_tranche_id, NULL);
+    dsa_pin(area);
+    dsa_set_size_limit(area, dsa_place_size);
+
+    keys_table_params.tranche_id = global_variables->dsa_tranche_id;
+    table = dshash_create(area, &keys_table_params, NULL);
+    global_variables->keys_table_handle = dshash_get_hash_table_handle(table);
+    names_table_params.tranche_id = global_variables->dsa_tranche_id;
+    names = dshash_create(area, &names_table_params, NULL);
+    global_variables->names_table_handle = dshash_get_hash_table_handle(names);
+
+    global_variables->excluded_errcodes = dsa_allocate(area, sizeof(int) * global_variables->excluded_errcodes_count);
+    excluded = dsa_get_address(area, global_variables->excluded_errcodes);
+    memcpy(excluded, excluded_errcodes_local, sizeof(int) * global_variables->excluded_errcodes_count);
+    pfree(excluded_errcodes_local);
+    excluded_errcodes_local = NULL;
+
+    /* Allocations above it fail and their messages are counted as dropped */
+    dsa_set_size_limit(area, dsa_size_limit());
+    dshash_detach(names);
+    dshash_detach(table);
+    dsa_detach(area);
 }
 
-static char*
-get_user_by_oid(Oid user_oid)
+static void check_novelty(MessageInfo *key);
+
+/*
+ * dshash raises on OOM when it allocates an item or grows its buckets, log
+ * hook must not raise while it holds our locks. Buckets of both tables are
+ * grown once to fit their maximum count of entries, by inserting and deleting
+ * placeholders which never match real keys: type of key is negative, name is
+ * empty. After that inserts of log hook only allocate items, which fit into
+ * DSA size limit while counts stay below max_keys and max names. A quarter
+ * more placeholders covers partitions filled above average. Called by bgworker.
+ */
+static void
+presize_tables(void)
 {
-    HeapTuple role_tuple;
-    char* result;
-    role_tuple = SearchSysCache1(AUTHOID, ObjectIdGetDatum(user_oid));
-    if (HeapTupleIsValid(role_tuple))
-    {
-        result = pstrdup(NameStr(((Form_pg_authid) GETSTRUCT(role_tuple))->rolname));
-        ReleaseSysCache(role_tuple);
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    uint32 max_names = names_per_chunk * max_name_chunks;
+    MessageInfo key;
+    NameKey name;
+    void *entry;
+    uint32 i;
+    bool found;
+
+    if (mb->tables_presized || !logerrors_attach_dsa())
+        return;
+    memset(&key, 0, sizeof(key));
+    key.message_type_index = -1;
+    for (i = 0; i < mb->max_keys + mb->max_keys / 4; ++i) {
+        key.error_code = (int) i;
+        entry = dshash_find_or_insert(keys_table, &key, &found);
+        dshash_release_lock(keys_table, entry);
     }
-    else
-        result = NULL;
-    return result;
+    for (i = 0; i < mb->max_keys + mb->max_keys / 4; ++i) {
+        key.error_code = (int) i;
+        dshash_delete_key(keys_table, &key);
+    }
+    memset(&name, 0, sizeof(name));
+    for (i = 0; i < max_names + max_names / 4; ++i) {
+        memcpy(&name.name[1], &i, sizeof(i));
+        entry = dshash_find_or_insert(names_table, &name, &found);
+        dshash_release_lock(names_table, entry);
+    }
+    for (i = 0; i < max_names + max_names / 4; ++i) {
+        memcpy(&name.name[1], &i, sizeof(i));
+        dshash_delete_key(names_table, &name);
+    }
+    LWLockAcquire(&mb->lock, LW_EXCLUSIVE);
+    mb->tables_presized = true;
+    LWLockRelease(&mb->lock);
 }
 
+static KeyChunk*
+get_key_chunk(uint32 id)
+{
+    return (KeyChunk *) dsa_get_address(logerrors_dsa, global_variables->messagesBuffer.chunks[id / keys_per_chunk]);
+}
 
-static void
-logerrors_init()
+/*
+ * Find entry of key, intern it if it is new. Returns NULL if key table is
+ * full or it can't be extended right now. Entry is returned locked: counters
+ * of its id are changed only under that lock, so reclaim_idle_keys() can free
+ * the id without racing with them. Caller releases it with dshash_release_lock().
+ */
+static KeyEntry*
+find_key_entry(MessageInfo *key)
 {
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    KeyEntry *entry;
+    KeyChunk *chunk;
+    uint32 keys_count;
+    uint32 id;
+    uint32 slot;
     bool found;
-    ErrorCode key;
-    ErrorName* err_name;
     int i;
-    for (i = 0; i < error_codes_count; ++i) {
-        key.num = error_codes[i];
-        err_name = hash_search(error_names_hashtable, (void *) &key, HASH_ENTER, &found);
-        err_name->name = (char*)error_names[i];
+
+    if (!logerrors_attach_dsa())
+        return NULL;
+    entry = dshash_find(keys_table, key, false);
+    if (entry != NULL)
+        return entry;
+    /* No allocations in critical section */
+    if (CritSectionCount > 0)
+        return NULL;
+
+    LWLockAcquire(&mb->lock, LW_EXCLUSIVE);
+    keys_count = pg_atomic_read_u32(&mb->keys_count);
+    if (!mb->tables_presized || (mb->free_count == 0 && keys_count >= mb->max_keys) ||
+        (key->client_id != 0 && pg_atomic_read_u32(&mb->client_keys_count) >= max_client_keys)) {
+        LWLockRelease(&mb->lock);
+        return NULL;
     }
-    pg_atomic_init_u32(&global_variables->messagesBuffer.current_message_index, 0);
-    MemSet(&global_variables->total_count, 0, message_types_count);
-    LWLockInitialize(&global_variables->messagesBuffer.lock, LWLockNewTrancheId());
-    for (i = 0; i < message_types_count; ++i) {
-        pg_atomic_init_u32(&global_variables->total_count[i], 0);
+    if (mb->free_count == 0 && keys_count % keys_per_chunk == 0 &&
+        !DsaPointerIsValid(mb->chunks[keys_count / keys_per_chunk])) {
+        mb->chunks[keys_count / keys_per_chunk] = dsa_allocate_extended(logerrors_dsa,
+                                                                         key_chunk_size(global_variables->actual_intervals_count,
+                                                                                        mb->track_volume,
+                                                                                        mb->track_times),
+                                                                         DSA_ALLOC_HUGE | DSA_ALLOC_NO_OOM | DSA_ALLOC_ZERO);
+        if (!DsaPointerIsValid(mb->chunks[keys_count / keys_per_chunk])) {
+            LWLockRelease(&mb->lock);
+            return NULL;
+        }
     }
-    for (i = 0; i < messages_per_interval * global_variables->actual_intervals_count; ++i) {
-        global_variables->messagesBuffer.buffer[i].error_code = -1;
-        global_variables->messagesBuffer.buffer[i].db_oid = -1;
-        global_variables->messagesBuffer.buffer[i].user_oid = -1;
-        global_variables->messagesBuffer.buffer[i].message_type_index = -1;
+    entry = dshash_find_or_insert(keys_table, key, &found);
+    if (!found) {
+        /* Idle ids are reused before the table grows */
+        if (mb->free_count > 0) {
+            id = mb->free_head;
+            chunk = get_key_chunk(id);
+            mb->free_head = chunk->next_free[id % keys_per_chunk];
+            mb->free_count--;
+        } else {
+            id = keys_count;
+            chunk = get_key_chunk(id);
+        }
+        slot = id % keys_per_chunk;
+        entry->id = id;
+        chunk->keys[slot] = *key;
+        chunk->mean[slot] = 0;
+        chunk->variance[slot] = 0;
+        chunk->samples[slot] = 0;
+        chunk->is_free[slot] = false;
+        /* Counters of this id may be left by reset, clear them before publishing */
+        for (i = 0; i < global_variables->actual_intervals_count; ++i) {
+            pg_atomic_write_u32(&chunk->counts[i * keys_per_chunk + slot], 0);
+            if (mb->track_volume)
+                pg_atomic_write_u64(&get_chunk_bytes(chunk)[i * keys_per_chunk + slot], 0);
+            if (mb->track_times) {
+                pg_atomic_write_u64(&get_chunk_first_seen(chunk)[i * keys_per_chunk + slot], 0);
+                pg_atomic_write_u64(&get_chunk_last_seen(chunk)[i * keys_per_chunk + slot], 0);
+            }
+        }
+        if (key->client_id != 0)
+            pg_atomic_fetch_add_u32(&mb->client_keys_count, 1);
+        if (track_novelty && key->message_type_index < message_types_count)
+            check_novelty(key);
+        pg_write_barrier();
+        if (id == keys_count)
+            pg_atomic_write_u32(&mb->keys_count, keys_count + 1);
     }
-    slow_log_info_init();
+    LWLockRelease(&mb->lock);
+    return entry;
+}
+
+static NameKey*
+get_name_by_id(uint32 id)
+{
+    NameKey *chunk;
+    if (id == 0 || id > pg_atomic_read_u32(&global_variables->messagesBuffer.names_count))
+        return NULL;
+    chunk = dsa_get_address(logerrors_dsa, global_variables->messagesBuffer.name_chunks[(id - 1) / names_per_chunk]);
+    return &chunk[(id - 1) % names_per_chunk];
 }
 
+/*
+ * Test error key in novelty filter and add it there. Only error code, type,
+ * database, user and message format are taken into account, message format
+ * is hashed by its text because name ids don't survive reset.
+ * Caller holds messagesBuffer.lock exclusively.
+ */
 static void
-logerrors_update_info()
+check_novelty(MessageInfo *key)
 {
+    struct {
+        int error_code;
+        int message_type_index;
+        Oid db_oid;
+        Oid user_oid;
+        uint32 format_hash;
+    } novelty_key;
+    NameKey *format;
+    NovelError *novel;
+    uint32 *filter;
+    uint32 h1;
+    uint32 h2;
+    uint32 bit;
+    bool seen = true;
     int i;
-    int current_index;
-    int prev_index;
-    if (global_variables == NULL) {
+
+    if (!DsaPointerIsValid(global_variables->novelty_filter))
         return;
+    filter = dsa_get_address(logerrors_dsa, global_variables->novelty_filter);
+    format = get_name_by_id(key->format_id);
+    memset(&novelty_key, 0, sizeof(novelty_key));
+    novelty_key.error_code = key->error_code;
+    novelty_key.message_type_index = key->message_type_index;
+    novelty_key.db_oid = key->db_oid;
+    novelty_key.user_oid = key->user_oid;
+    if (format != NULL)
+        novelty_key.format_hash = DatumGetUInt32(hash_any((const unsigned char *) format->name,
+                                                          strlen(format->name)));
+    /* Double hashing gives all probes from two hashes */
+    h1 = DatumGetUInt32(hash_any((const unsigned char *) &novelty_key, sizeof(novelty_key)));
+    h2 = DatumGetUInt32(hash_uint32(h1)) | 1;
+    for (i = 0; i < novelty_filter_hashes; ++i) {
+        bit = (h1 + i * h2) % novelty_filter_bits;
+        if ((filter[bit / 32] & (1U << (bit % 32))) == 0) {
+            seen = false;
+            filter[bit / 32] |= 1U << (bit % 32);
+        }
     }
-    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
-    prev_index = global_variables->messagesBuffer.current_interval_index;
-    global_variables->messagesBuffer.current_interval_index = (prev_index + 1)
-                                                              % global_variables->actual_intervals_count;
-    current_index = global_variables->messagesBuffer.current_interval_index;
-    for (i = 0; i < messages_per_interval; ++i) {
-        global_variables->messagesBuffer.buffer[i + current_index * messages_per_interval].error_code = -1;
-        global_variables->messagesBuffer.buffer[i + current_index * messages_per_interval].db_oid = -1;
-        global_variables->messagesBuffer.buffer[i + current_index * messages_per_interval].user_oid = -1;
-        global_variables->messagesBuffer.buffer[i + current_index * messages_per_interval].message_type_index = -1;
-    }
-    pg_atomic_write_u32(&global_variables->messagesBuffer.current_message_index, 0);
-    LWLockRelease(&global_variables->messagesBuffer.lock);
+    if (seen)
+        return;
+    global_variables->novelty_filter_dirty = true;
+    novel = &global_variables->novel_errors[global_variables->novel_errors_next++ % max_novel_errors];
+    novel->first_seen = GetCurrentTimestamp();
+    novel->error_code = key->error_code;
+    novel->db_oid = key->db_oid;
+    novel->user_oid = key->user_oid;
+    novel->message_type_index = key->message_type_index;
+    if (format != NULL)
+        strlcpy(novel->message, format->name, sizeof(novel->message));
+    else
+        novel->message[0] = '\0';
 }
 
-void
-logerrors_main(Datum main_arg)
+/*
+ * Intern name, returns its id or 0 if there is no name or names table is full.
+ * Name is truncated to name_key_length - 1 bytes.
+ */
+static uint32
+get_name_id(const char *name)
 {
-    int cur_dur = 0;
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    NameKey key;
+    NameEntry *entry;
+    NameKey *chunk;
+    uint32 names_count;
+    uint32 id;
+    bool found;
 
-    /* Register functions for SIGTERM management */
-    pqsignal(SIGTERM, logerrors_sigterm);
+    if (name == NULL || name[0] == '\0' || !logerrors_attach_dsa())
+        return 0;
+    memset(&key, 0, sizeof(key));
+    strlcpy(key.name, name, name_key_length);
+    entry = dshash_find(names_table, &key, false);
+    if (entry != NULL) {
+        id = entry->id;
+        dshash_release_lock(names_table, entry);
+        return id;
+    }
+    if (CritSectionCount > 0)
+        return 0;
 
-    /* We're now ready to receive signals */
-    BackgroundWorkerUnblockSignals();
+    LWLockAcquire(&mb->lock, LW_EXCLUSIVE);
+    names_count = pg_atomic_read_u32(&mb->names_count);
+    if (!mb->tables_presized || names_count >= names_per_chunk * max_name_chunks) {
+        LWLockRelease(&mb->lock);
+        return 0;
+    }
+    if (names_count % names_per_chunk == 0 && !DsaPointerIsValid(mb->name_chunks[names_count / names_per_chunk])) {
+        mb->name_chunks[names_count / names_per_chunk] = dsa_allocate_extended(logerrors_dsa,
+                                                                               sizeof(NameKey) * names_per_chunk,
+                                                                               DSA_ALLOC_NO_OOM);
+        if (!DsaPointerIsValid(mb->name_chunks[names_count / names_per_chunk])) {
+            LWLockRelease(&mb->lock);
+            return 0;
+        }
+    }
+    entry = dshash_find_or_insert(names_table, &key, &found);
+    if (!found) {
+        entry->id = names_count + 1;
+        chunk = dsa_get_address(logerrors_dsa, mb->name_chunks[names_count / names_per_chunk]);
+        chunk[names_count % names_per_chunk] = key;
+        pg_write_barrier();
+        pg_atomic_write_u32(&mb->names_count, names_count + 1);
+    }
+    id = entry->id;
+    dshash_release_lock(names_table, entry);
+    LWLockRelease(&mb->lock);
+    return id;
+}
 
-    logerrors_init();
-    while (!got_sigterm)
-    {
-        int rc;
-        /* Wait necessary amount of time */
-        rc = WaitLatch(&MyProc->procLatch,
-                       WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, interval, PG_WAIT_EXTENSION);
+/* Local caches of locations and formats, recreated when shared names are reset */
+static bool
+prepare_locations_cache(void)
+{
+    HASHCTL ctl;
+    uint32 generation;
 
-        ResetLatch(&MyProc->procLatch);
-        /* Emergency bailout if postmaster has died */
-        if (rc & WL_POSTMASTER_DEATH)
-            proc_exit(1);
-        /* Process signals */
+    generation = pg_atomic_read_u32(&global_variables->messagesBuffer.names_generation);
+    if (locations_cache != NULL && locations_cache_generation != generation) {
+        hash_destroy(locations_cache);
+        hash_destroy(formats_cache);
+        locations_cache = NULL;
+        formats_cache = NULL;
+    }
+    if (locations_cache == NULL) {
+        if (CritSectionCount > 0)
+            return false;
+        memset(&ctl, 0, sizeof(ctl));
+        ctl.keysize = sizeof(LocationKey);
+        ctl.entrysize = sizeof(LocationEntry);
+        ctl.hcxt = TopMemoryContext;
+        locations_cache = hash_create("logerrors locations", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+        memset(&ctl, 0, sizeof(ctl));
+        ctl.keysize = sizeof(NameKey);
+        ctl.entrysize = sizeof(FormatEntry);
+        ctl.hcxt = TopMemoryContext;
+        formats_cache = hash_create("logerrors formats", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+        locations_cache_generation = generation;
+    }
+    return true;
+}
 
-        if (got_sigterm)
-        {
-            /* Simply exit */
-            elog(DEBUG1, "bgworker logerrors signal: processed SIGTERM");
-            proc_exit(0);
-        }
-        /* Main work happens here */
-        logerrors_update_info();
+/* Find or intern location of message through local cache */
+static void
+get_location_ids(ErrorData *edata, uint32 *location_id, uint32 *funcname_id)
+{
+    LocationKey key;
+    LocationEntry *entry;
+    bool found;
+    char location[name_key_length];
 
-        cur_dur += interval;
-        if (cur_dur < stats_persistence_interval)
-            continue;
-        cur_dur = 0;
-        write_to_stat_file();
+    if (!prepare_locations_cache())
+        return;
+    memset(&key, 0, sizeof(key));
+    key.filename = edata->filename;
+    key.lineno = edata->lineno;
+    key.funcname = edata->funcname;
+    entry = hash_search(locations_cache, (void *) &key, HASH_FIND, &found);
+    if (!found) {
+        if (CritSectionCount > 0)
+            return;
+        snprintf(location, sizeof(location), "%s:%d", edata->filename, edata->lineno);
+        entry = hash_search(locations_cache, (void *) &key, HASH_ENTER, &found);
+        entry->location_id = get_name_id(location);
+        entry->funcname_id = get_name_id(edata->funcname);
     }
-
-    /* No problems, so clean exit */
-    proc_exit(0);
+    *location_id = entry->location_id;
+    *funcname_id = entry->funcname_id;
 }
 
-static int
-create_dir_if_not_exist(char *dirname, bool *created, bool *empty)
+/* Find or intern untranslated message format through local cache */
+static uint32
+get_format_id(ErrorData *edata)
 {
-    switch (pg_check_dir(dirname))
-    {
-        case 0:
-
-            /*
-             * Does not exist, so create
-             */
-            if (pg_mkdir_p(dirname, pg_dir_create_mode) == -1)
-                return -1;
-            if (created)
-                *created = true;
-            return 0;
-        case 1:
+    NameKey key;
+    FormatEntry *entry;
+    bool found;
 
-            /*
-             * Exists, empty
-             */
-            if (empty)
-                *empty = true;
+    if (edata->message_id == NULL || !prepare_locations_cache())
+        return 0;
+    /* Truncated like shared names */
+    memset(&key, 0, sizeof(key));
+    strlcpy(key.name, edata->message_id, name_key_length);
+    entry = hash_search(formats_cache, (void *) &key, HASH_FIND, &found);
+    if (!found) {
+        if (CritSectionCount > 0)
             return 0;
-        case 2:
-        case 3:
-        case 4:
+        entry = hash_search(formats_cache, (void *) &key, HASH_ENTER, &found);
+        entry->format_id = get_name_id(key.name);
+    }
+    return entry->format_id;
+}
 
-            /*
-             * Exists, not empty
-             */
-            if (empty)
-                *empty =  false;
+/* Index of message type in log_type_names, -1 if message is not written to server log */
+static int
+get_log_type_index(ErrorData *edata)
+{
+    if (!edata->output_to_server)
+        return -1;
+    switch (edata->elevel) {
+        case WARNING:
             return 0;
+        case ERROR:
+            return 1;
+        case FATAL:
+            return 2;
+        case PANIC:
+            return 3;
+        case NOTICE:
+            return 4;
+        case INFO:
+            return 5;
+        case LOG:
+        case LOG_SERVER_ONLY:
+            return 6;
         default:
-            return -1;
+            return edata->elevel < LOG ? 7 : -1;
     }
 }
 
-static void
-get_current_stats_file(char* path)
+/* Approximate size of message in server log */
+static uint32
+get_message_bytes(ErrorData *edata)
 {
-    char buf[32] = {0};
-    pg_time_t now = (pg_time_t)time(NULL);
+    uint32 bytes = 0;
+    if (edata->message)
+        bytes += strlen(edata->message);
+    if (edata->detail_log)
+        bytes += strlen(edata->detail_log);
+    else if (edata->detail)
+        bytes += strlen(edata->detail);
+    if (edata->hint)
+        bytes += strlen(edata->hint);
+    if (edata->context)
+        bytes += strlen(edata->context);
+    if (debug_query_string != NULL && edata->elevel >= log_min_error_statement && !edata->hide_stmt)
+        bytes += strlen(debug_query_string);
+    return bytes;
+}
 
-    pg_strftime(buf,
-                sizeof(buf),
-                "/stats-%Y-%m-%d.csv",
-                pg_localtime(&now, log_timezone));
-    strcat(path, "/");
-    strcat(path, buf);
+static bool
+is_contention_errcode(int sqlerrcode)
+{
+    int i;
+    for (i = 0; i < contention_errcodes_count; ++i) {
+        if (sqlerrcode == contention_errcodes[i])
+            return true;
+    }
+    return false;
 }
 
-static int
-replace_pgdata_env(char** path)
+/* Copy quoted name following pattern in str to buf */
+static bool
+find_quoted_name(const char *str, const char *pattern, char *buf, size_t size)
 {
-    if (!path || !(*path))
-        return -1;
+    const char *start;
+    const char *end;
+    if (str == NULL || (start = strstr(str, pattern)) == NULL)
+        return false;
+    start += strlen(pattern);
+    end = strchr(start, '"');
+    if (end == NULL || end == start)
+        return false;
+    strlcpy(buf, start, Min(size, end - start + 1));
+    return true;
+}
 
-    if (strcmp(*path, "$pgdata") ==0)
-        return -1;
-    if (strcmp(*path, "$pgdata/") ==0)
-        return -1;
-    if (strncmp(*path, "$pgdata/", strlen("$pgdata/"))==0)
-        *path = *path + strlen("$pgdata/");
-    return 0;
+/*
+ * Texts of messages are searched for relation only when lc_messages leaves them
+ * in English, server returns msgid itself when it has no translation.
+ */
+static bool
+is_untranslated(const char *msgid)
+{
+#ifdef ENABLE_NLS
+    return strcmp(dgettext(PG_TEXTDOMAIN("postgres"), msgid), msgid) == 0;
+#else
+    return true;
+#endif
 }
 
+/*
+ * Relation of lock or serialization failure, from error fields when they are
+ * set. Otherwise it is found in texts and only for untranslated messages.
+ * Context entry of row lock wait keeps relation in its arg, but its callback
+ * is not exported, so only its text can be recognized. Relations known only
+ * by oid are stored as "#oid" and resolved by reader. Lock wait is already
+ * cleaned up when timeout or cancel is reported, so heavyweight lock being
+ * waited for is not known.
+ */
 static void
-remove_end_separator(char* path)
+get_contention_relation(ErrorData *edata, char *buf, size_t size)
 {
-    char *ptr = NULL;
-    do
+    const char *detail;
+    unsigned int relid;
+    unsigned int dbid;
+
+    buf[0] = '\0';
+    if (edata->table_name != NULL) {
+        if (edata->schema_name != NULL)
+            snprintf(buf, size, "%s.%s", edata->schema_name, edata->table_name);
+        else
+            strlcpy(buf, edata->table_name, size);
+        return;
+    }
+    /* "while updating tuple (0,1) in relation \"t\"" */
+    if (is_untranslated("while updating tuple (%u,%u) in relation \"%s\"") &&
+        find_quoted_name(edata->context, "in relation \"", buf, size))
+        return;
+    /* "could not obtain lock on relation \"t\"" */
+    if (is_untranslated("could not obtain lock on relation \"%s\"") &&
+        find_quoted_name(edata->message, "relation \"", buf, size))
+        return;
+    /* Deadlock detail: "... waits for ShareLock on relation 16384 of database 5; ..." */
+    detail = is_untranslated("relation %u of database %u") ? edata->detail : NULL;
+    while (detail != NULL && (detail = strstr(detail, "relation ")) != NULL) {
+        detail += strlen("relation ");
+        if (sscanf(detail, "%u of database %u", &relid, &dbid) == 2 && dbid == MyDatabaseId) {
+            snprintf(buf, size, "#%u", relid);
+            return;
+        }
+    }
+}
+
+static bool
+is_auth_errcode(int sqlerrcode)
+{
+    int i;
+    for (i = 0; i < auth_errcodes_count; ++i) {
+        if (sqlerrcode == auth_errcodes[i])
+            return true;
+    }
+    return false;
+}
+
+/* Numeric address of connected client, "local" for Unix sockets, empty when unknown */
+static void
+get_client_addr(char *buf, size_t size)
+{
+    buf[0] = '\0';
+    if (MyProcPort == NULL)
+        return;
+    if (MyProcPort->raddr.addr.ss_family == AF_UNIX) {
+        strlcpy(buf, "local", size);
+        return;
+    }
+    if (pg_getnameinfo_all(&MyProcPort->raddr.addr, MyProcPort->raddr.salen,
+                           buf, size, NULL, 0, NI_NUMERICHOST) != 0)
+        buf[0] = '\0';
+}
+
+/*
+ * Innermost PL/pgSQL function of the last report. While track_plfunctions is
+ * on, PL/pgSQL plugin pushes one static context callback under the outermost
+ * function call. errfinish() calls it before error is thrown, it finds the
+ * innermost PL/pgSQL context entry on the stack, so the function is known
+ * without catalog access or parsing of translated context. Errors caught by
+ * EXCEPTION blocks are never emitted, report is forgotten when subtransaction
+ * aborts or any function returns.
+ */
+static Oid plfunction_report_oid = InvalidOid;
+static char plfunction_report_signature[name_key_length];
+static ErrorContextCallback plfunction_context;
+/* Context callback of PL/pgSQL executor, its argument is the execstate */
+static void (*plpgsql_context_callback) (void *arg) = NULL;
+
+static void
+plfunction_error_callback(void *arg)
+{
+    PLpgSQL_execstate *estate;
+    ErrorContextCallback *econtext;
+
+    for (econtext = error_context_stack; econtext != NULL; econtext = econtext->previous) {
+        if (econtext->callback == plpgsql_context_callback)
+            break;
+    }
+    if (econtext == NULL)
+        return;
+    estate = (PLpgSQL_execstate *) econtext->arg;
+    if (estate->func->fn_signature == NULL)
+        return;
+    plfunction_report_oid = estate->func->fn_oid;
+    strlcpy(plfunction_report_signature, estate->func->fn_signature, sizeof(plfunction_report_signature));
+}
+
+static void
+plfunction_forget_report(void)
+{
+    plfunction_report_oid = InvalidOid;
+    plfunction_report_signature[0] = '\0';
+}
+
+/*
+ * Calls are forwarded. PL/pgSQL fills its own pointers only in our struct, so
+ * copy them to the previous plugin (pldebugger, plpgsql_check) before its setup.
+ */
+static void
+plfunction_setup(PLpgSQL_execstate *estate, PLpgSQL_function *func)
+{
+    if (prev_plpgsql_plugin == NULL)
+        return;
+    prev_plpgsql_plugin->error_callback = plfunction_plugin.error_callback;
+    prev_plpgsql_plugin->assign_expr = plfunction_plugin.assign_expr;
+#if (PG_VERSION_NUM >= 150000)
+    prev_plpgsql_plugin->assign_value = plfunction_plugin.assign_value;
+    prev_plpgsql_plugin->eval_datum = plfunction_plugin.eval_datum;
+    prev_plpgsql_plugin->cast_value = plfunction_plugin.cast_value;
+#endif
+    if (prev_plpgsql_plugin->func_setup)
+        prev_plpgsql_plugin->func_setup(estate, func);
+}
+
+static void
+plfunction_begin(PLpgSQL_execstate *estate, PLpgSQL_function *func)
+{
+    ErrorContextCallback *econtext;
+
+    /* PL/pgSQL pushes its context entry for the call before func_beg */
+    if (track_plfunctions && error_context_stack != NULL && error_context_stack->arg == (void *) estate)
+        plpgsql_context_callback = error_context_stack->callback;
+    if (prev_plpgsql_plugin != NULL && prev_plpgsql_plugin->func_beg)
+        prev_plpgsql_plugin->func_beg(estate, func);
+    if (!track_plfunctions || plpgsql_context_callback == NULL)
+        return;
+    /* Nested calls share entry of the outermost one, stack is restored on error by PG_TRY of caller */
+    for (econtext = error_context_stack; econtext != NULL; econtext = econtext->previous) {
+        if (econtext == &plfunction_context)
+            return;
+    }
+    plfunction_context.callback = plfunction_error_callback;
+    plfunction_context.arg = (void *) estate;
+    plfunction_context.previous = error_context_stack;
+    error_context_stack = &plfunction_context;
+}
+
+static void
+plfunction_end(PLpgSQL_execstate *estate, PLpgSQL_function *func)
+{
+    if (error_context_stack == &plfunction_context && plfunction_context.arg == (void *) estate)
+        error_context_stack = plfunction_context.previous;
+    if (track_plfunctions)
+        plfunction_forget_report();
+    if (prev_plpgsql_plugin != NULL && prev_plpgsql_plugin->func_end)
+        prev_plpgsql_plugin->func_end(estate, func);
+}
+
+static void
+plfunction_stmt_begin(PLpgSQL_execstate *estate, PLpgSQL_stmt *stmt)
+{
+    if (prev_plpgsql_plugin != NULL && prev_plpgsql_plugin->stmt_beg)
+        prev_plpgsql_plugin->stmt_beg(estate, stmt);
+}
+
+static void
+plfunction_stmt_end(PLpgSQL_execstate *estate, PLpgSQL_stmt *stmt)
+{
+    if (prev_plpgsql_plugin != NULL && prev_plpgsql_plugin->stmt_end)
+        prev_plpgsql_plugin->stmt_end(estate, stmt);
+}
+
+static PLpgSQL_plugin plfunction_plugin = {
+    plfunction_setup,
+    plfunction_begin,
+    plfunction_end,
+    plfunction_stmt_begin,
+    plfunction_stmt_end
+};
+
+static void
+plfunction_xact_callback(XactEvent event, void *arg)
+{
+    if (event == XACT_EVENT_ABORT || event == XACT_EVENT_PARALLEL_ABORT)
+        plfunction_forget_report();
+}
+
+static void
+plfunction_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+                            SubTransactionId parentSubid, void *arg)
+{
+    if (event == SUBXACT_EVENT_ABORT_SUB)
+        plfunction_forget_report();
+}
+
+/*
+ * Class of statement by its first keyword: command tag of active portal when
+ * statement is executed, first word of query text otherwise (e.g. for parse
+ * errors). Only a few bytes are looked at, no parsing happens.
+ */
+static uint32
+get_statement_class(void)
+{
+    const char *p = NULL;
+    char word[16];
+    int len = 0;
+
+    if (ActivePortal != NULL) {
+#if (PG_VERSION_NUM >= 130000)
+        if (ActivePortal->commandTag != CMDTAG_UNKNOWN)
+            p = GetCommandTagName(ActivePortal->commandTag);
+#else
+        p = ActivePortal->commandTag;
+#endif
+    }
+    if (p == NULL && debug_query_string != NULL) {
+        p = debug_query_string;
+        /* Skip spaces, comments and parentheses before the first keyword */
+        for (;;) {
+            while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '(')
+                p++;
+            if (p[0] == '-' && p[1] == '-') {
+                p = strchr(p, '\n');
+                if (p == NULL)
+                    return 0;
+            } else if (p[0] == '/' && p[1] == '*') {
+                p = strstr(p + 2, "*/");
+                if (p == NULL)
+                    return 0;
+                p += 2;
+            } else {
+                break;
+            }
+        }
+    }
+    if (p == NULL)
+        return 0;
+    while (len < (int) sizeof(word) - 1 && ((p[len] >= 'a' && p[len] <= 'z') || (p[len] >= 'A' && p[len] <= 'Z'))) {
+        word[len] = pg_ascii_toupper((unsigned char) p[len]);
+        len++;
+    }
+    word[len] = '\0';
+    if (len == 0)
+        return 0;
+    if (strcmp(word, "SELECT") == 0 || strcmp(word, "WITH") == 0 || strcmp(word, "VALUES") == 0 ||
+        strcmp(word, "TABLE") == 0 || strcmp(word, "FETCH") == 0)
+        return statement_class_select;
+    if (strcmp(word, "INSERT") == 0 || strcmp(word, "UPDATE") == 0 || strcmp(word, "DELETE") == 0 ||
+        strcmp(word, "MERGE") == 0)
+        return statement_class_dml;
+    if (strcmp(word, "CREATE") == 0 || strcmp(word, "ALTER") == 0 || strcmp(word, "DROP") == 0 ||
+        strcmp(word, "TRUNCATE") == 0 || strcmp(word, "COMMENT") == 0 || strcmp(word, "GRANT") == 0 ||
+        strcmp(word, "REVOKE") == 0 || strcmp(word, "SECURITY") == 0 || strcmp(word, "IMPORT") == 0)
+        return statement_class_ddl;
+    return statement_class_utility;
+}
+
+/* Fill optional dimensions of key from message */
+static void
+fill_message_key(ErrorData *edata, MessageInfo *key)
+{
+    char relation[name_key_length];
+    if (track_relations && (edata->table_name != NULL || edata->constraint_name != NULL)) {
+        if (edata->table_name == NULL)
+            relation[0] = '\0';
+        else if (edata->schema_name != NULL)
+            snprintf(relation, sizeof(relation), "%s.%s", edata->schema_name, edata->table_name);
+        else
+            strlcpy(relation, edata->table_name, sizeof(relation));
+        key->relation_id = get_name_id(relation);
+        key->constraint_id = get_name_id(edata->constraint_name);
+    }
+    if (track_locations && edata->filename != NULL)
+        get_location_ids(edata, &key->location_id, &key->funcname_id);
+    if (track_contention && is_contention_errcode(edata->sqlerrcode)) {
+        get_contention_relation(edata, relation, sizeof(relation));
+        key->relation_id = get_name_id(relation);
+#if (PG_VERSION_NUM >= 140000)
+        key->queryid = pgstat_get_my_query_id();
+#endif
+    }
+    if (track_auth_clients && is_auth_errcode(edata->sqlerrcode)) {
+        get_client_addr(relation, sizeof(relation));
+        key->client_id = get_name_id(relation);
+    }
+    if (track_statement_class)
+        key->statement_class = get_statement_class();
+    if (track_plfunctions && plfunction_report_signature[0] != '\0') {
+        key->plfunction_id = get_name_id(plfunction_report_signature);
+        if (key->plfunction_id != 0)
+            key->plfunction_oid = plfunction_report_oid;
+    }
+}
+
+/*
+ * Wake up backends in pg_log_errors_wait() when count of key in current interval
+ * reaches threshold of one of them, so each key wakes them once per interval.
+ * Sampled messages add more than one, so threshold is looked for in (prev_count, count].
+ */
+static void
+signal_error_waiters(uint32 prev_count, uint32 count)
+{
+    int i;
+    uint32 threshold;
+    for (i = 0; i < max_error_waiters; ++i) {
+        threshold = pg_atomic_read_u32(&global_variables->wait_thresholds[i]);
+        if (threshold > prev_count && threshold <= count) {
+            ConditionVariableBroadcast(&global_variables->wait_cv);
+            return;
+        }
+    }
+}
+
+/*
+ * Weight of warning or error of this backend: 1 while it writes less than
+ * logerrors.sampling_threshold of them per second of current interval, so the
+ * limit of interval is threshold * interval. Volume and slow statement keys
+ * are always exact and don't take part in the rate.
+ * Above that message is counted with probability 1/weight and adds weight,
+ * which keeps sums unbiased. Weight doubles with each doubling of the rate,
+ * sampling stops by itself when the next interval starts. Returns 0 if
+ * message is skipped.
+ */
+static uint32
+get_sampling_weight(int interval_index)
+{
+    uint64 limit;
+    uint64 excess;
+    int shift = 1;
+
+    if (sampling_threshold <= 0)
+        return 1;
+    if (interval_index != sampling_interval_index) {
+        sampling_interval_index = interval_index;
+        sampling_messages = 0;
+    }
+    sampling_messages++;
+    limit = Max((uint64) sampling_threshold * global_variables->interval / 1000, 1);
+    if (sampling_messages <= limit)
+        return 1;
+    for (excess = sampling_messages / limit; excess > 1 && shift < max_sampling_shift; excess >>= 1)
+        shift++;
+    /* xorshift64, seeded once per backend */
+    if (sampling_random == 0)
+        sampling_random = ((uint64) MyProcPid << 32) ^ (uint64) GetCurrentTimestamp() ^ 0x9E3779B97F4A7C15;
+    sampling_random ^= sampling_random << 13;
+    sampling_random ^= sampling_random >> 7;
+    sampling_random ^= sampling_random << 17;
+    if ((sampling_random & (((uint64) 1 << shift) - 1)) != 0)
+        return 0;
+    return (uint32) 1 << shift;
+}
+
+/*
+ * Move first and last message times of counter slot to now. Relaxed atomic
+ * min and max: first time is set once per interval, last time is changed
+ * only by the latest message, 0 means no message yet.
+ */
+static void
+update_seen_times(KeyChunk *chunk, int slot)
+{
+    uint64 now = (uint64) GetCurrentTimestamp();
+    pg_atomic_uint64 *first_seen = &get_chunk_first_seen(chunk)[slot];
+    pg_atomic_uint64 *last_seen = &get_chunk_last_seen(chunk)[slot];
+    uint64 seen;
+
+    seen = pg_atomic_read_u64(first_seen);
+    while ((seen == 0 || now < seen) && !pg_atomic_compare_exchange_u64(first_seen, &seen, now))
+        ;
+    seen = pg_atomic_read_u64(last_seen);
+    while (now > seen && !pg_atomic_compare_exchange_u64(last_seen, &seen, now))
+        ;
+}
+
+/* Raise fill of interval to cover id, fill only grows until rotation clears it */
+static void
+update_interval_fill(int interval_index, uint32 fill)
+{
+    pg_atomic_uint32 *interval_fill = &global_variables->interval_fill[interval_index];
+    uint32 prev_fill = pg_atomic_read_u32(interval_fill);
+
+    while (prev_fill < fill && !pg_atomic_compare_exchange_u32(interval_fill, &prev_fill, fill))
+        ;
+}
+
+/* Count message, returns weight it was counted with (0 if skipped by sampling) */
+static uint32
+add_message(MessageInfo *key, uint32 bytes) {
+    uint32 id;
+    uint32 slot;
+    uint32 weight;
+    uint32 prev_count;
+    int interval_index;
+    KeyEntry *entry;
+    KeyChunk *chunk;
+    if (global_variables == NULL)
+        return 0;
+    /* Lock-free: rotation clears next interval before making it current */
+    interval_index = ((volatile MessagesBuffer *) &global_variables->messagesBuffer)->current_interval_index;
+    weight = key->message_type_index < message_types_count ? get_sampling_weight(interval_index) : 1;
+    if (weight == 0)
+        return 0;
+    entry = find_key_entry(key);
+    /* Too many clients, count message without client address */
+    if (entry == NULL && key->client_id != 0) {
+        key->client_id = 0;
+        entry = find_key_entry(key);
+    }
+    if (entry == NULL) {
+        pg_atomic_fetch_add_u64(&global_variables->messagesBuffer.dropped_count, weight);
+        return weight;
+    }
+    id = entry->id;
+    slot = interval_index * keys_per_chunk + id % keys_per_chunk;
+    chunk = get_key_chunk(id);
+    prev_count = pg_atomic_fetch_add_u32(&chunk->counts[slot], weight);
+    update_interval_fill(interval_index, id + 1);
+    if (bytes > 0 && global_variables->messagesBuffer.track_volume)
+        pg_atomic_fetch_add_u64(&get_chunk_bytes(chunk)[slot], (uint64) bytes * weight);
+    if (global_variables->messagesBuffer.track_times)
+        update_seen_times(chunk, slot);
+    dshash_release_lock(keys_table, entry);
+    if (key->message_type_index < message_types_count && pg_atomic_read_u32(&global_variables->waiters_count) > 0)
+        signal_error_waiters(prev_count, prev_count + weight);
+    if (weight > 1) {
+        /* Counted weight has variance weight - 1, weight * (weight - 1) is its unbiased estimate */
+        pg_atomic_fetch_add_u64(&global_variables->sampled_counts[interval_index], weight);
+        pg_atomic_fetch_add_u64(&global_variables->sampled_variance[interval_index], (uint64) weight * (weight - 1));
+    }
+    return weight;
+}
+
+static char*
+get_user_by_oid(Oid user_oid)
+{
+    HeapTuple role_tuple;
+    char* result;
+    role_tuple = SearchSysCache1(AUTHOID, ObjectIdGetDatum(user_oid));
+    if (HeapTupleIsValid(role_tuple))
     {
-        ptr = strrchr(path, '\\');
-        if (!ptr)
+        result = pstrdup(NameStr(((Form_pg_authid) GETSTRUCT(role_tuple))->rolname));
+        ReleaseSysCache(role_tuple);
+    }
+    else
+        result = NULL;
+    return result;
+}
+
+
+static void
+logerrors_init()
+{
+    bool found;
+    ErrorCode key;
+    ErrorName* err_name;
+    int i;
+    for (i = 0; i < error_codes_count; ++i) {
+        key.num = error_codes[i];
+        err_name = hash_search(error_names_hashtable, (void *) &key, HASH_ENTER, &found);
+        err_name->name = (char*)error_names[i];
+    }
+    MemSet(&global_variables->total_count, 0, message_types_count);
+    for (i = 0; i < message_types_count; ++i) {
+        pg_atomic_init_u32(&global_variables->total_count[i], 0);
+    }
+    slow_log_info_init();
+    SpinLockAcquire(&global_variables->suspects_lock);
+    memset(global_variables->suspects, 0, sizeof(global_variables->suspects));
+    SpinLockRelease(&global_variables->suspects_lock);
+}
+
+/* Forget all interned keys, their chunks are kept for reuse */
+static void
+logerrors_reset_keys()
+{
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    KeyChunk *chunk;
+    NameKey *name_chunk;
+    uint32 keys_count;
+    uint32 names_count;
+    uint32 id;
+    if (!logerrors_attach_dsa())
+        return;
+    LWLockAcquire(&mb->lock, LW_EXCLUSIVE);
+    keys_count = pg_atomic_read_u32(&mb->keys_count);
+    pg_atomic_write_u32(&mb->keys_count, 0);
+    for (id = 0; id < keys_count; ++id) {
+        chunk = get_key_chunk(id);
+        dshash_delete_key(keys_table, &chunk->keys[id % keys_per_chunk]);
+    }
+    names_count = pg_atomic_read_u32(&mb->names_count);
+    pg_atomic_write_u32(&mb->names_count, 0);
+    pg_atomic_fetch_add_u32(&mb->names_generation, 1);
+    for (id = 1; id <= names_count; ++id) {
+        name_chunk = dsa_get_address(logerrors_dsa, mb->name_chunks[(id - 1) / names_per_chunk]);
+        dshash_delete_key(names_table, &name_chunk[(id - 1) % names_per_chunk]);
+    }
+    pg_atomic_write_u64(&mb->dropped_count, 0);
+    pg_atomic_write_u32(&mb->client_keys_count, 0);
+    mb->free_head = invalid_key_id;
+    mb->free_count = 0;
+    mb->reclaimed_count = 0;
+    mb->capacity_warning = false;
+    for (id = 0; id < max_actual_intervals_count; ++id) {
+        pg_atomic_write_u64(&global_variables->sampled_counts[id], 0);
+        pg_atomic_write_u64(&global_variables->sampled_variance[id], 0);
+        pg_atomic_write_u32(&global_variables->interval_fill[id], 0);
+    }
+    if (DsaPointerIsValid(global_variables->slow_top)) {
+        SpinLockAcquire(&global_variables->slow_top_lock);
+        memset(dsa_get_address(logerrors_dsa, global_variables->slow_top), 0,
+               sizeof(SlowTop) * global_variables->actual_intervals_count);
+        SpinLockRelease(&global_variables->slow_top_lock);
+    }
+    /* Novelty filter is history, only the ring of recent novel errors is cleared */
+    global_variables->novel_errors_next = 0;
+    memset(global_variables->novel_errors, 0, sizeof(global_variables->novel_errors));
+    /* Flagged keys refer to names being forgotten */
+    global_variables->anomalies_next = 0;
+    memset(global_variables->anomalies, 0, sizeof(global_variables->anomalies));
+    LWLockRelease(&mb->lock);
+}
+
+/* Add database to list if it is not there yet */
+static void
+add_sampled_database(Oid *db_oids, int *db_count, Oid db_oid)
+{
+    int i;
+    if (!OidIsValid(db_oid) || *db_count >= max_sampled_databases)
+        return;
+    for (i = 0; i < *db_count; ++i) {
+        if (db_oids[i] == db_oid)
             return;
-        if (*(ptr+1) == '\0')
-            *ptr = 0;
     }
-    while(ptr);
+    db_oids[(*db_count)++] = db_oid;
+}
+
+/*
+ * Store transactions committed and rolled back during closing interval for databases
+ * with connected backends or messages in buffer. Called by bgworker only.
+ */
+static void
+sample_xact_stats(int interval_index)
+{
+    Oid db_oids[max_sampled_databases];
+    int db_count = 0;
+    XactCounters counters[max_sampled_databases];
+    XactSample *samples;
+    PgStat_StatDBEntry *db_entry;
+    KeyChunk *chunk;
+    uint32 fill = 0;
+    uint32 base;
+    uint32 slot;
+    uint32 i;
+    int j;
+
+    if (!DsaPointerIsValid(global_variables->xact_samples)) {
+        global_variables->xact_samples = dsa_allocate_extended(logerrors_dsa,
+                                                               sizeof(XactSample) * max_sampled_databases *
+                                                               global_variables->actual_intervals_count,
+                                                               DSA_ALLOC_NO_OOM | DSA_ALLOC_ZERO);
+        if (!DsaPointerIsValid(global_variables->xact_samples))
+            return;
+    }
+    samples = (XactSample *) dsa_get_address(logerrors_dsa, global_variables->xact_samples) +
+              interval_index * max_sampled_databases;
+
+    for (i = 0; i < ProcGlobal->allProcCount; ++i)
+        add_sampled_database(db_oids, &db_count, ProcGlobal->allProcs[i].databaseId);
+    /* Ids above fill of every interval have no messages in buffer, freed ids keep stale keys */
+    for (j = 0; j < global_variables->actual_intervals_count; ++j)
+        fill = Max(fill, pg_atomic_read_u32(&global_variables->interval_fill[j]));
+    fill = Min(fill, pg_atomic_read_u32(&global_variables->messagesBuffer.keys_count));
+    for (base = 0; base < fill; base += keys_per_chunk) {
+        chunk = get_key_chunk(base);
+        for (slot = 0; slot < Min(fill - base, keys_per_chunk); ++slot) {
+            if (!chunk->is_free[slot])
+                add_sampled_database(db_oids, &db_count, chunk->keys[slot].db_oid);
+        }
+    }
+
+    memset(samples, 0, sizeof(XactSample) * max_sampled_databases);
+    for (j = 0; j < db_count; ++j) {
+        db_entry = pgstat_fetch_stat_dbentry(db_oids[j]);
+        counters[j].db_oid = db_oids[j];
+        if (db_entry == NULL) {
+            counters[j].xact_commit = 0;
+            counters[j].xact_rollback = 0;
+            continue;
+        }
+#if (PG_VERSION_NUM >= 150000)
+        counters[j].xact_commit = db_entry->xact_commit;
+        counters[j].xact_rollback = db_entry->xact_rollback;
+#else
+        counters[j].xact_commit = db_entry->n_xact_commit;
+        counters[j].xact_rollback = db_entry->n_xact_rollback;
+#endif
+    }
+    pgstat_clear_snapshot();
+
+    /* Delta since previous interval, database seen first time gives baseline only */
+    for (j = 0; j < db_count; ++j) {
+        samples[j].db_oid = counters[j].db_oid;
+        for (i = 0; i < last_xact_counters_count; ++i) {
+            if (last_xact_counters[i].db_oid != counters[j].db_oid)
+                continue;
+            /* Counters go back after stats reset */
+            samples[j].xact_commit = Max(counters[j].xact_commit - last_xact_counters[i].xact_commit, 0);
+            samples[j].xact_rollback = Max(counters[j].xact_rollback - last_xact_counters[i].xact_rollback, 0);
+            break;
+        }
+    }
+    memcpy(last_xact_counters, counters, sizeof(XactCounters) * db_count);
+    last_xact_counters_count = db_count;
+}
+
+/*
+ * Score closed interval of each key against decayed mean and variance of its
+ * previous intervals, then add interval to them (Welford's method with
+ * exponential forgetting over about intervals_count intervals).
+ * Caller holds messagesBuffer.lock exclusively.
+ */
+static void
+update_anomaly_scores(int interval_index, uint32 keys_count)
+{
+    double alpha = 2.0 / (global_variables->intervals_count + 1);
+    double mean;
+    double stddev;
+    double score;
+    double diff;
+    double increment;
+    uint32 id;
+    uint32 slot;
+    uint32 count;
+    TimestampTz now = GetCurrentTimestamp();
+    KeyChunk *chunk;
+    Anomaly *anomaly;
+
+    for (id = 0; id < keys_count; ++id) {
+        chunk = get_key_chunk(id);
+        slot = id % keys_per_chunk;
+        count = pg_atomic_read_u32(&chunk->counts[interval_index * keys_per_chunk + slot]);
+        mean = chunk->mean[slot];
+        if (anomaly_threshold > 0 && chunk->samples[slot] >= anomaly_min_samples) {
+            /* Counts are integers, deviation below one message is noise */
+            stddev = Max(sqrt(chunk->variance[slot]), 1.0);
+            score = (count - mean) / stddev;
+            if (score >= anomaly_threshold) {
+                anomaly = &global_variables->anomalies[global_variables->anomalies_next++ % max_anomalies];
+                anomaly->detected_at = now;
+                anomaly->key = chunk->keys[slot];
+                anomaly->count = count;
+                anomaly->mean = mean;
+                anomaly->stddev = sqrt(chunk->variance[slot]);
+                anomaly->score = score;
+            }
+        }
+        diff = count - mean;
+        increment = alpha * diff;
+        chunk->mean[slot] = mean + increment;
+        chunk->variance[slot] = (1 - alpha) * (chunk->variance[slot] + diff * increment);
+        if (chunk->samples[slot] < anomaly_min_samples)
+            chunk->samples[slot]++;
+    }
+}
+
+static void
+logerrors_update_info()
+{
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    int i;
+    int next_index;
+    uint32 id;
+    uint32 keys_count;
+    uint32 keys_in_use;
+    bool warn;
+    bool raise_warning;
+    KeyChunk *chunk;
+    SlowTop *top;
+    if (global_variables == NULL || !logerrors_attach_dsa()) {
+        return;
+    }
+    /* Only bgworker moves current interval, so it can be read without lock */
+    sample_xact_stats(global_variables->messagesBuffer.current_interval_index);
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
+    next_index = (global_variables->messagesBuffer.current_interval_index + 1)
+                 % global_variables->actual_intervals_count;
+    keys_count = pg_atomic_read_u32(&global_variables->messagesBuffer.keys_count);
+    update_anomaly_scores(global_variables->messagesBuffer.current_interval_index, keys_count);
+    for (id = 0; id < keys_count; id += keys_per_chunk) {
+        chunk = get_key_chunk(id);
+        for (i = 0; i < keys_per_chunk; ++i) {
+            pg_atomic_write_u32(&chunk->counts[next_index * keys_per_chunk + i], 0);
+            if (global_variables->messagesBuffer.track_volume)
+                pg_atomic_write_u64(&get_chunk_bytes(chunk)[next_index * keys_per_chunk + i], 0);
+            if (global_variables->messagesBuffer.track_times) {
+                pg_atomic_write_u64(&get_chunk_first_seen(chunk)[next_index * keys_per_chunk + i], 0);
+                pg_atomic_write_u64(&get_chunk_last_seen(chunk)[next_index * keys_per_chunk + i], 0);
+            }
+        }
+    }
+    pg_atomic_write_u64(&global_variables->sampled_counts[next_index], 0);
+    pg_atomic_write_u64(&global_variables->sampled_variance[next_index], 0);
+    pg_atomic_write_u32(&global_variables->interval_fill[next_index], 0);
+    if (DsaPointerIsValid(global_variables->slow_top)) {
+        SpinLockAcquire(&global_variables->slow_top_lock);
+        top = (SlowTop *) dsa_get_address(logerrors_dsa, global_variables->slow_top) + next_index;
+        top->count = 0;
+        pg_atomic_write_u64(&top->threshold, 0);
+        SpinLockRelease(&global_variables->slow_top_lock);
+    }
+    /* Writers read current interval without lock, it must be clean before they see it */
+    pg_write_barrier();
+    global_variables->messagesBuffer.current_interval_index = next_index;
+    reclaim_idle_keys(keys_count);
+    keys_in_use = keys_count - mb->free_count;
+    warn = (uint64) keys_in_use * 100 >= (uint64) mb->max_keys * capacity_warning_percent;
+    /* Written under the lock like other fields read by pg_log_errors_capacity() */
+    raise_warning = warn && !mb->capacity_warning;
+    mb->capacity_warning = warn;
+    /* Warning is counted by our own hook, which takes the lock */
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+    if (raise_warning)
+        ereport(WARNING,
+                (errmsg("logerrors: %u of %u keys are in use, messages with new keys may be not counted",
+                        keys_in_use, mb->max_keys),
+                 errhint("Increase logerrors.max_memory or decrease logerrors.intervals_count.")));
+}
+
+/* Bgworker is connected to publish_database */
+static bool publish_connected = false;
+
+/*
+ * Connection FATALs when publish_database is missing, was dropped or doesn't
+ * allow connections. Restarted bgworker then runs unconnected and doesn't
+ * publish instead of failing every bgw_restart_time.
+ */
+static void
+publish_connect(void)
+{
+    if (publish_database == NULL || publish_database[0] == '\0')
+        return;
+    if (global_variables->publish_unavailable) {
+        ereport(WARNING,
+                (errmsg("logerrors: could not connect to database \"%s\", counters are not published",
+                        publish_database),
+                 errhint("Create the database or change logerrors.publish_database and restart the server.")));
+        return;
+    }
+    global_variables->publish_unavailable = true;
+    BackgroundWorkerInitializeConnection(publish_database, NULL, 0);
+    global_variables->publish_unavailable = false;
+    publish_connected = true;
+}
+
+static void
+logerrors_worker_detach(int code, Datum arg)
+{
+    global_variables->worker_latch = NULL;
+}
+
+void
+logerrors_main(Datum main_arg)
+{
+    int cur_dur = 0;
+    int prometheus_dur = 0;
+    TimestampTz next_update;
+    TimestampTz next_urgent = 0;
+    TimestampTz now;
+    long timeout;
+
+    /* Register functions for SIGTERM management */
+    pqsignal(SIGTERM, logerrors_sigterm);
+
+    /* We're now ready to receive signals */
+    BackgroundWorkerUnblockSignals();
+
+    /* Before anything else, so failed connection loses nothing */
+    publish_connect();
+    logerrors_init();
+    /* Top of slowest statements is allocated once, reset below clears it after restart */
+    if (logerrors_attach_dsa() && !DsaPointerIsValid(global_variables->slow_top))
+        global_variables->slow_top = dsa_allocate_extended(logerrors_dsa,
+                                                           sizeof(SlowTop) * global_variables->actual_intervals_count,
+                                                           DSA_ALLOC_NO_OOM | DSA_ALLOC_ZERO);
+    /* Filter is kept after restart of bgworker, so it is never freed */
+    if (track_novelty && logerrors_attach_dsa() && !DsaPointerIsValid(global_variables->novelty_filter))
+        global_variables->novelty_filter = dsa_allocate_extended(logerrors_dsa, novelty_filter_bits / 8,
+                                                                 DSA_ALLOC_NO_OOM | DSA_ALLOC_ZERO);
+    logerrors_reset_keys();
+    presize_tables();
+    read_novelty_filter();
+    export_open();
+    push_open();
+    global_variables->worker_latch = &MyProc->procLatch;
+    before_shmem_exit(logerrors_worker_detach, (Datum) 0);
+    next_update = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), interval);
+    while (!got_sigterm)
+    {
+        int rc;
+        /* Wait necessary amount of time, urgent messages wake us up earlier */
+        now = GetCurrentTimestamp();
+        timeout = now < next_update ? (long) ((next_update - now) / 1000) : 0;
+        if (pg_atomic_read_u32(&global_variables->urgent_pending) != 0)
+            timeout = Min(timeout, now < next_urgent ? (long) ((next_urgent - now) / 1000) : 0);
+        rc = WaitLatch(&MyProc->procLatch,
+                       WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, timeout, PG_WAIT_EXTENSION);
+
+        ResetLatch(&MyProc->procLatch);
+        /* Emergency bailout if postmaster has died */
+        if (rc & WL_POSTMASTER_DEATH)
+            proc_exit(1);
+        /* Process signals */
+
+        if (got_sigterm)
+        {
+            /* Simply exit */
+            elog(DEBUG1, "bgworker logerrors signal: processed SIGTERM");
+            save_novelty_filter();
+            proc_exit(0);
+        }
+        /*
+         * At most one urgent message per interval is handled. Pending flag is
+         * left set until then, so backends don't wake us up during a storm.
+         */
+        now = GetCurrentTimestamp();
+        if (now >= next_urgent && pg_atomic_exchange_u32(&global_variables->urgent_pending, 0) != 0) {
+            handle_urgent_message();
+            next_urgent = TimestampTzPlusMilliseconds(now, interval);
+        }
+        if (now < next_update)
+            continue;
+        next_update = TimestampTzPlusMilliseconds(next_update, interval);
+        /* Don't try to catch up after long stall */
+        if (next_update <= now)
+            next_update = TimestampTzPlusMilliseconds(now, interval);
+        /* Main work happens here */
+        logerrors_update_info();
+        export_update();
+        push_update();
+        publish_interval();
+
+        prometheus_dur += interval;
+        if (prometheus_dur >= prometheus_interval) {
+            prometheus_dur = 0;
+            write_prometheus_file();
+        }
+
+        cur_dur += interval;
+        if (cur_dur < stats_persistence_interval)
+            continue;
+        write_to_stat_file();
+        write_errors_file(Min(cur_dur / interval, global_variables->intervals_count));
+        cur_dur = 0;
+        save_novelty_filter();
+    }
+
+    /* No problems, so clean exit */
+    save_novelty_filter();
+    proc_exit(0);
+}
+
+static int
+create_dir_if_not_exist(char *dirname, bool *created, bool *empty)
+{
+    switch (pg_check_dir(dirname))
+    {
+        case 0:
+
+            /*
+             * Does not exist, so create
+             */
+            if (pg_mkdir_p(dirname, pg_dir_create_mode) == -1)
+                return -1;
+            if (created)
+                *created = true;
+            return 0;
+        case 1:
+
+            /*
+             * Exists, empty
+             */
+            if (empty)
+                *empty = true;
+            return 0;
+        case 2:
+        case 3:
+        case 4:
+
+            /*
+             * Exists, not empty
+             */
+            if (empty)
+                *empty =  false;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static void
+get_current_stats_file(char* path)
+{
+    char buf[32] = {0};
+    pg_time_t now = (pg_time_t)time(NULL);
+
+    pg_strftime(buf,
+                sizeof(buf),
+                "/stats-%Y-%m-%d.csv",
+                pg_localtime(&now, log_timezone));
+    strcat(path, "/");
+    strcat(path, buf);
+}
+
+static int
+replace_pgdata_env(char** path)
+{
+    if (!path || !(*path))
+        return -1;
+
+    if (strcmp(*path, "$pgdata") ==0)
+        return -1;
+    if (strcmp(*path, "$pgdata/") ==0)
+        return -1;
+    if (strncmp(*path, "$pgdata/", strlen("$pgdata/"))==0)
+        *path = *path + strlen("$pgdata/");
+    return 0;
+}
+
+static void
+remove_end_separator(char* path)
+{
+    char *ptr = NULL;
+    do
+    {
+        ptr = strrchr(path, '\\');
+        if (!ptr)
+            return;
+        if (*(ptr+1) == '\0')
+            *ptr = 0;
+    }
+    while(ptr);
+}
+
+static int
+create_file_if_not_exist(char* path)
+{
+    struct stat stat_buff;
+    int flags = O_RDWR|O_APPEND;
+
+    if (stat(path, &stat_buff) != 0)
+    {
+        if (errno != ENOENT)
+            return -1;
+        flags |= O_CREAT;
+    }
+    else
+    {
+        if (S_ISREG(stat_buff.st_mode) == 0)
+            return -1;
+    }
+    return OpenTransientFile(path, flags);
+}
+
+/* Current time in format of stats files, timebuf must have 64 bytes */
+static void
+format_stats_time(char *timebuf)
+{
+    char msbuf[8] = {0};
+    struct timeval tv;
+    pg_time_t sec;
+
+    gettimeofday(&tv, NULL);
+    sec = (pg_time_t) tv.tv_sec;
+    pg_strftime(timebuf,
+                64,
+                "%Y-%m-%d %H:%M:%S        %Z",
+                pg_localtime(&sec, log_timezone));
+    sprintf(msbuf, ".%06d", (int) (tv.tv_usec));
+    strncpy(timebuf + 19, msbuf, 7);
+}
+
+static void
+write_line_to_stat_file(int fd)
+{
+    uint32 tmp[4] = {0};
+    char buf[256] = {0};
+    char timebuf[64] = {0};
+
+    Assert(sizeof(tmp) == sizeof(last_stats_counter));
+
+    format_stats_time(timebuf);
+
+    tmp[0] = pg_atomic_read_u32(&global_variables->total_count[0]);
+    tmp[1] = pg_atomic_read_u32(&global_variables->total_count[1]);
+    tmp[2] = pg_atomic_read_u32(&global_variables->total_count[2]);
+    tmp[3] = pg_atomic_read_u32(&global_variables->slow_log_info.count);
+
+    sprintf(buf, "%s,%d,%d,%d,%d,0,0,0,0,0\n",
+            timebuf,
+            tmp[0]-last_stats_counter[0],
+            tmp[1]-last_stats_counter[1],
+            tmp[2]-last_stats_counter[2],
+            tmp[3]-last_stats_counter[3]);
+
+    write(fd, buf, strlen(buf));
+    memcpy(last_stats_counter, tmp, sizeof(tmp));
+}
+
+/* Directory of stats files in stats_temp_directory, returns false if it is not usable */
+static bool
+get_stats_directory(char *path)
+{
+    Assert(stats_temp_directory);
+    if (replace_pgdata_env(&stats_temp_directory) == -1)
+        return false;
+    remove_end_separator(stats_temp_directory);
+
+    strcat(path, stats_temp_directory);
+    strcat(path, "/stats");
+    return true;
+}
+
+void
+write_to_stat_file()
+{
+
+    char stats_path[256] = {0};
+    char log_path[256] = {0};
+    int fd = -1;
+
+    if (global_variables == NULL)
+        return;
+
+    if (!get_stats_directory(stats_path))
+        return;
+    strcat(log_path, stats_temp_directory);
+    strcat(log_path, "/log");
+    if (create_dir_if_not_exist(stats_path, NULL, NULL) != 0)
+        return;
+    if (create_dir_if_not_exist(log_path, NULL, NULL) != 0)
+        return;
+
+    get_current_stats_file(stats_path);
+    fd = create_file_if_not_exist(stats_path);
+    if (fd < 0)
+        return;
+    write_line_to_stat_file(fd);
+    CloseTransientFile(fd);
+}
+
+/* Load novelty filter saved by previous run, keys seen since startup are kept */
+static void
+read_novelty_filter(void)
+{
+    char path[256] = {0};
+    NoveltyFileHeader header;
+    uint32 *words;
+    uint32 *filter;
+    FILE *file;
+    int i;
+
+    if (!DsaPointerIsValid(global_variables->novelty_filter) || !get_stats_directory(path))
+        return;
+    strcat(path, "/novelty.bloom");
+    file = AllocateFile(path, PG_BINARY_R);
+    if (file == NULL)
+        return;
+    words = palloc(novelty_filter_bits / 8);
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != novelty_filter_magic ||
+        header.bits != novelty_filter_bits ||
+        header.hashes != novelty_filter_hashes ||
+        fread(words, novelty_filter_bits / 8, 1, file) != 1) {
+        elog(LOG, "logerrors: ignoring invalid novelty filter file \"%s\"", path);
+    } else {
+        LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
+        filter = dsa_get_address(logerrors_dsa, global_variables->novelty_filter);
+        for (i = 0; i < novelty_filter_bits / 32; ++i)
+            filter[i] |= words[i];
+        LWLockRelease(&global_variables->messagesBuffer.lock);
+    }
+    pfree(words);
+    FreeFile(file);
+}
+
+/* Save novelty filter next to stats files if it was changed, file is replaced atomically */
+static void
+save_novelty_filter(void)
+{
+    char path[256] = {0};
+    char tmp_path[256 + 4];
+    NoveltyFileHeader header;
+    uint32 *words;
+    FILE *file;
+    bool written;
+
+    if (global_variables == NULL || !global_variables->novelty_filter_dirty)
+        return;
+    if (!get_stats_directory(path) || create_dir_if_not_exist(path, NULL, NULL) != 0)
+        return;
+    strcat(path, "/novelty.bloom");
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    /* Copy filter, new keys are not blocked while it is written */
+    words = palloc(novelty_filter_bits / 8);
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
+    memcpy(words, dsa_get_address(logerrors_dsa, global_variables->novelty_filter), novelty_filter_bits / 8);
+    global_variables->novelty_filter_dirty = false;
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = novelty_filter_magic;
+    header.bits = novelty_filter_bits;
+    header.hashes = novelty_filter_hashes;
+    file = AllocateFile(tmp_path, PG_BINARY_W);
+    if (file == NULL) {
+        elog(WARNING, "logerrors: could not create file \"%s\": %m", tmp_path);
+        written = false;
+    } else {
+        written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(words, novelty_filter_bits / 8, 1, file) == 1;
+        if (FreeFile(file) != 0 || !written || rename(tmp_path, path) != 0) {
+            elog(WARNING, "logerrors: could not write file \"%s\": %m", path);
+            written = false;
+        }
+    }
+    pfree(words);
+    /* Try again next time */
+    if (!written)
+        global_variables->novelty_filter_dirty = true;
+}
+
+
+static bool
+is_urgent_message(ErrorData *edata)
+{
+    int i;
+    if (edata->elevel >= PANIC)
+        return true;
+    if (edata->elevel < ERROR)
+        return false;
+    for (i = 0; i < global_variables->urgent_errcodes_count; ++i) {
+        if (global_variables->urgent_is_class[i] ?
+            ERRCODE_TO_CATEGORY(edata->sqlerrcode) == global_variables->urgent_errcodes[i] :
+            edata->sqlerrcode == global_variables->urgent_errcodes[i])
+            return true;
+    }
+    return false;
+}
+
+/* Wake up bgworker once until it handles the message */
+static void
+notify_urgent_message(ErrorData *edata)
+{
+    Latch *latch;
+    pg_atomic_write_u32(&global_variables->urgent_errcode, (uint32) edata->sqlerrcode);
+    pg_atomic_write_u32(&global_variables->urgent_elevel, (uint32) edata->elevel);
+    pg_atomic_fetch_add_u32(&global_variables->urgent_count, 1);
+    if (pg_atomic_exchange_u32(&global_variables->urgent_pending, 1) != 0)
+        return;
+    latch = ((volatile GlobalInfo *) global_variables)->worker_latch;
+    if (latch != NULL)
+        SetLatch(latch);
+}
+
+/*
+ * Write the last urgent message and count of them since previous write to
+ * logerrors.urgent_file, so external tools can watch it. File is replaced
+ * atomically.
+ */
+static void
+write_urgent_file(int sqlerrcode, int elevel, uint32 count)
+{
+    char path[MAXPGPATH];
+    char tmp_path[MAXPGPATH];
+    char* urgent_path = urgent_file;
+    FILE *file;
+
+    if (urgent_path == NULL || urgent_path[0] == '\0' || replace_pgdata_env(&urgent_path) == -1)
+        return;
+    strlcpy(path, urgent_path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = AllocateFile(tmp_path, PG_BINARY_W);
+    if (file == NULL) {
+        elog(WARNING, "logerrors: could not create file \"%s\": %m", tmp_path);
+        return;
+    }
+    fprintf(file, "%s,%s,%s,%u\n",
+            timestamptz_to_str(GetCurrentTimestamp()),
+            elevel >= PANIC ? "PANIC" : message_type_names[elevel >= FATAL ? 2 : 1],
+            unpack_sql_state(sqlerrcode), count);
+    if (FreeFile(file) != 0 || rename(tmp_path, path) != 0)
+        elog(WARNING, "logerrors: could not write file \"%s\": %m", path);
+}
+
+/*
+ * Notify about urgent messages at once. Stats file keeps one line per
+ * persistence interval and the server log is what we measure, so only
+ * urgent file is written.
+ */
+static void
+handle_urgent_message(void)
+{
+    int sqlerrcode = (int) pg_atomic_read_u32(&global_variables->urgent_errcode);
+    int elevel = (int) pg_atomic_read_u32(&global_variables->urgent_elevel);
+
+    write_urgent_file(sqlerrcode, elevel, pg_atomic_exchange_u32(&global_variables->urgent_count, 0));
+}
+
+/* Query id if it is computed, hash of statement text otherwise */
+static uint64
+get_statement_id(void)
+{
+    uint64 statement_id = 0;
+#if (PG_VERSION_NUM >= 140000)
+    statement_id = pgstat_get_my_query_id();
+#endif
+    if (statement_id == 0 && debug_query_string != NULL)
+        statement_id = DatumGetUInt32(hash_any((const unsigned char *) debug_query_string,
+                                               strlen(debug_query_string)));
+    return statement_id;
+}
+
+/*
+ * Put backend to suspects table, replacing its previous entry or the least
+ * recent one, expired entries are the least recent
+ */
+static void
+update_retry_suspect(Oid user_oid, TimestampTz now)
+{
+    int i;
+    RetrySuspect *suspect = NULL;
+    SpinLockAcquire(&global_variables->suspects_lock);
+    for (i = 0; i < max_retry_suspects; ++i) {
+        if (global_variables->suspects[i].pid == MyProcPid) {
+            suspect = &global_variables->suspects[i];
+            break;
+        }
+        if (suspect == NULL || global_variables->suspects[i].last_time < suspect->last_time)
+            suspect = &global_variables->suspects[i];
+    }
+    suspect->pid = MyProcPid;
+    suspect->db_oid = MyDatabaseId;
+    suspect->user_oid = user_oid;
+    suspect->role_oid = MyProc->roleId;
+    suspect->error_code = retry_run_error_code;
+    suspect->statement_id = retry_run_statement_id;
+    suspect->run_length = retry_run_length;
+    suspect->last_time = now;
+    SpinLockRelease(&global_variables->suspects_lock);
+}
+
+/* Track run length of identical errors, report backend repeating them */
+static void
+detect_retry_loop(ErrorData *edata, Oid user_oid)
+{
+    TimestampTz now;
+    uint64 statement_id;
+    if (retry_loop_threshold <= 0 || edata->elevel != ERROR)
+        return;
+    now = GetCurrentTimestamp();
+    statement_id = get_statement_id();
+    if (edata->sqlerrcode != retry_run_error_code || statement_id != retry_run_statement_id ||
+        TimestampDifferenceExceeds(retry_run_last_time, now, retry_loop_max_gap_ms)) {
+        retry_run_error_code = edata->sqlerrcode;
+        retry_run_statement_id = statement_id;
+        retry_run_length = 0;
+    }
+    retry_run_length += 1;
+    retry_run_last_time = now;
+    if (retry_run_length < (uint64) retry_loop_threshold)
+        return;
+    /* Update shared entry on crossing the threshold and then often enough to keep it from expiring */
+    if (retry_run_length == (uint64) retry_loop_threshold ||
+        TimestampDifferenceExceeds(retry_suspect_updated, now, retry_loop_max_gap_ms)) {
+        update_retry_suspect(user_oid, now);
+        retry_suspect_updated = now;
+    }
+}
+
+static void
+slow_top_sift_down(SlowTop *top, int i)
+{
+    int smallest;
+    SlowStatement tmp;
+    for (;;) {
+        smallest = i;
+        if (2 * i + 1 < top->count && top->statements[2 * i + 1].duration < top->statements[smallest].duration)
+            smallest = 2 * i + 1;
+        if (2 * i + 2 < top->count && top->statements[2 * i + 2].duration < top->statements[smallest].duration)
+            smallest = 2 * i + 2;
+        if (smallest == i)
+            return;
+        tmp = top->statements[i];
+        top->statements[i] = top->statements[smallest];
+        top->statements[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static void
+slow_top_sift_up(SlowTop *top, int i)
+{
+    SlowStatement tmp;
+    while (i > 0 && top->statements[(i - 1) / 2].duration > top->statements[i].duration) {
+        tmp = top->statements[i];
+        top->statements[i] = top->statements[(i - 1) / 2];
+        top->statements[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+/* Put slow statement to top of current interval if it is slow enough */
+static void
+add_slow_statement(ErrorData *edata, Oid user_oid)
+{
+    const char *duration_str;
+    const char *query;
+    double duration;
+    int interval_index;
+    SlowTop *top;
+    SlowStatement statement;
+    uint64 threshold;
+
+    if (!DsaPointerIsValid(global_variables->slow_top) || !logerrors_attach_dsa())
+        return;
+    duration_str = strstr(edata->message, "duration:");
+    duration = strtod(duration_str + strlen("duration:"), NULL);
+    interval_index = ((volatile MessagesBuffer *) &global_variables->messagesBuffer)->current_interval_index;
+    top = (SlowTop *) dsa_get_address(logerrors_dsa, global_variables->slow_top) + interval_index;
+    /* Cheap check without lock, most statements are not the slowest */
+    threshold = pg_atomic_read_u64(&top->threshold);
+    if (threshold != 0 && duration * 1000.0 < (double) threshold)
+        return;
+    /* Message has statement when it is not logged separately */
+    query = debug_query_string != NULL ? debug_query_string : edata->message;
+    statement.duration = duration;
+    statement.seen_at = GetCurrentTimestamp();
+    statement.db_oid = MyDatabaseId;
+    statement.user_oid = user_oid;
+#if (PG_VERSION_NUM >= 140000)
+    statement.queryid = pgstat_get_my_query_id();
+#else
+    statement.queryid = 0;
+#endif
+    strlcpy(statement.query, query, slow_query_length);
+
+    SpinLockAcquire(&global_variables->slow_top_lock);
+    if (top->count < slow_top_count) {
+        top->statements[top->count++] = statement;
+        slow_top_sift_up(top, top->count - 1);
+    } else if (top->statements[0].duration < duration) {
+        top->statements[0] = statement;
+        slow_top_sift_down(top, 0);
+    }
+    /* Rounded down, so the check above never skips statement slower than the fastest kept */
+    if (top->count == slow_top_count)
+        pg_atomic_write_u64(&top->threshold, (uint64) (top->statements[0].duration * 1000.0));
+    SpinLockRelease(&global_variables->slow_top_lock);
+}
+
+/* Set while the hook counts a message, reports raised meanwhile are not counted */
+static bool in_log_hook = false;
+
+/* Count message in shared counters, called by log hook */
+static void
+count_log_message(ErrorData *edata)
+{
+    int lvl_i;
+    int err_code_index;
+    int *excluded;
+    bool skip;
+    int sec_context;
+    int log_type_index;
+    uint32 bytes = 0;
+    uint32 format_id = 0;
+    uint32 weight;
+    Oid user_oid;
+    MessageInfo key;
+    if (is_urgent_message(edata))
+        notify_urgent_message(edata);
+    /* GetUserId() asserts that user is known, it is not during authentication */
+    GetUserIdAndSecContext(&user_oid, &sec_context);
+    detect_retry_loop(edata, user_oid);
+    log_type_index = get_log_type_index(edata);
+    if (track_volume && log_type_index >= 0 && logerrors_attach_dsa()) {
+        bytes = get_message_bytes(edata);
+        format_id = get_format_id(edata);
+    }
+    for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i)
+    {
+        /* Only current message type */
+        if (edata->elevel != message_types_codes[lvl_i])
+            continue;
+        if (!logerrors_attach_dsa())
+            continue;
+        excluded = dsa_get_address(logerrors_dsa, global_variables->excluded_errcodes);
+        skip = false;
+        for (err_code_index = 0; err_code_index < global_variables->excluded_errcodes_count; ++err_code_index) {
+            if (edata->sqlerrcode == excluded[err_code_index]) {
+                skip = true;
+                break;
+            }
+        }
+        if (skip)
+            continue;
+        memset(&key, 0, sizeof(key));
+        key.error_code = edata->sqlerrcode;
+        key.db_oid = MyDatabaseId;
+        key.user_oid = user_oid;
+        key.message_type_index = lvl_i;
+        key.format_id = format_id;
+        fill_message_key(edata, &key);
+        weight = add_message(&key, bytes);
+        if (weight > 0)
+            pg_atomic_fetch_add_u32(&global_variables->total_count[lvl_i], weight);
+    }
+    /* Other messages are counted only for volume, user is not interesting there */
+    if (track_volume && log_type_index >= message_types_count && logerrors_attach_dsa()) {
+        memset(&key, 0, sizeof(key));
+        key.error_code = edata->sqlerrcode;
+        key.db_oid = MyDatabaseId;
+        key.message_type_index = log_type_index;
+        key.format_id = format_id;
+        add_message(&key, bytes);
+    }
+    if (edata && edata->message && strstr(edata->message, "duration:"))
+    {
+        pg_atomic_fetch_add_u32(&global_variables->slow_log_info.count, 1);
+        if (logerrors_attach_dsa()) {
+            memset(&key, 0, sizeof(key));
+            key.db_oid = MyDatabaseId;
+            key.user_oid = user_oid;
+            key.message_type_index = slow_log_type_index;
+            key.application_id = get_name_id(application_name);
+#if (PG_VERSION_NUM >= 140000)
+            key.queryid = pgstat_get_my_query_id();
+#endif
+            add_message(&key, 0);
+        }
+        add_slow_statement(edata, user_oid);
+    }
+}
+
+/*
+ * Log hook. Counting takes our locks, a report raised meanwhile (e.g. OOM
+ * while attaching to DSA) would come back here and wait for them forever.
+ */
+void
+logerrors_emit_log_hook(ErrorData *edata)
+{
+    /* Only if hashtable already inited */
+    if (global_variables != NULL && MyProc != NULL && !proc_exit_inprogress && !got_sigterm && !in_log_hook) {
+        in_log_hook = true;
+        PG_TRY();
+        {
+            count_log_message(edata);
+        }
+        PG_CATCH();
+        {
+            in_log_hook = false;
+            PG_RE_THROW();
+        }
+        PG_END_TRY();
+        in_log_hook = false;
+    }
+    /* Each report is taken once, next one outside of functions has no function */
+    plfunction_forget_report();
+
+    if (prev_emit_log_hook) {
+        prev_emit_log_hook(edata);
+    }
+}
+
+static void
+logerrors_load_params(void)
+{
+    DefineCustomIntVariable("logerrors.interval",
+                            "Time between writing stat to buffer (ms).",
+                            "Default of 5s, max of 60s",
+                            &interval,
+                            5000,
+                            1000,
+                            60000,
+                            PGC_SUSET,
+                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.intervals_count",
+                            "Count of intervals in buffer",
+                            "Default of 120, max of 360",
+                            &intervals_count,
+                            120,
+                            2,
+                            max_intervals_count,
+                            PGC_SUSET,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomStringVariable("logerrors.excluded_errcodes",
+                               "Excluded error codes separated by ','",
+                               NULL,
+                               &excluded_errcodes_str,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.urgent_errcodes",
+                               "Error classes and codes separated by ',' which are persisted at once",
+                               "PANIC messages are always urgent",
+                               &urgent_errcodes_str,
+                               "53",
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.urgent_file",
+                               "File rewritten on each urgent message",
+                               NULL,
+                               &urgent_file,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.export_file",
+                               "Memory-mapped file updated by bgworker each interval for local collectors",
+                               NULL,
+                               &export_file,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.push_socket",
+                               "Unix datagram socket receiving counters of each interval in statsd format",
+                               NULL,
+                               &push_socket,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.publish_database",
+                               "Database bgworker connects to for emitting counters of each interval as logical decoding messages",
+                               NULL,
+                               &publish_database,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomStringVariable("logerrors.prometheus_directory",
+                               "Directory of node_exporter textfile collector to write logerrors.prom to",
+                               NULL,
+                               &prometheus_directory,
+                               NULL,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomIntVariable("logerrors.prometheus_interval",
+                            "Time between writes of logerrors.prom (ms)",
+                            "Default of 15s, rounded up to logerrors.interval",
+                            &prometheus_interval,
+                            15000,
+                            1000,
+                            3600000,
+                            PGC_POSTMASTER,
+                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomStringVariable("logerrors.stats_temp_directory",
+                               "Stats will be persisted in this directory",
+                               NULL,
+                               &stats_temp_directory,
+                               default_stats_temp_directory,
+                               PGC_POSTMASTER,
+                               GUC_NO_RESET_ALL,
+                               NULL,
+                               NULL,
+                               NULL);
+    DefineCustomIntVariable("logerrors.stats_flush_interval",
+                            "Stats persistence interval",
+                            "Default of 60s, max of 5min",
+                            &stats_persistence_interval,
+                            60*1000,
+                            5*1000,
+                            5*60*1000,
+                            PGC_SUSET,
+                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomBoolVariable("logerrors.track_relations",
+                             "Count messages by relation and constraint they refer to",
+                             NULL,
+                             &track_relations,
+                             false,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_locations",
+                             "Count messages by source file, line and function raising them",
+                             NULL,
+                             &track_locations,
+                             false,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_statement_class",
+                             "Count messages by class of statement raising them (SELECT, DML, DDL or UTILITY)",
+                             NULL,
+                             &track_statement_class,
+                             false,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_plfunctions",
+                             "Count messages by innermost PL/pgSQL function raising them",
+                             NULL,
+                             &track_plfunctions,
+                             false,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_contention",
+                             "Count lock and serialization failures by relation and query",
+                             NULL,
+                             &track_contention,
+                             true,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_auth_clients",
+                             "Count authentication failures by client address",
+                             NULL,
+                             &track_auth_clients,
+                             true,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomIntVariable("logerrors.retry_loop_threshold",
+                            "Count of identical errors in a row making backend a retry loop suspect",
+                            "0 disables retry loop detection",
+                            &retry_loop_threshold,
+                            0,
+                            0,
+                            INT_MAX,
+                            PGC_SUSET,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomIntVariable("logerrors.sampling_threshold",
+                            "Warnings and errors per second of one backend above which they are counted by sampling",
+                            "0 disables sampling",
+                            &sampling_threshold,
+                            0,
+                            0,
+                            INT_MAX,
+                            PGC_SUSET,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomBoolVariable("logerrors.track_novelty",
+                             "Remember errors never seen before by type, sqlstate, user, database and message",
+                             NULL,
+                             &track_novelty,
+                             true,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomRealVariable("logerrors.anomaly_threshold",
+                             "Flag interval count of key deviating from its mean by that many standard deviations",
+                             "0 disables anomaly detection",
+                             &anomaly_threshold,
+                             4.0,
+                             0.0,
+                             100.0,
+                             PGC_SUSET,
+                             GUC_NO_RESET_ALL,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomIntVariable("logerrors.anomaly_min_samples",
+                            "Intervals of key counted before anomaly detector scores it",
+                            NULL,
+                            &anomaly_min_samples,
+                            12,
+                            1,
+                            1000,
+                            PGC_SUSET,
+                            GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+    DefineCustomBoolVariable("logerrors.track_volume",
+                             "Count bytes of all messages written to server log by type, database and message",
+                             NULL,
+                             &track_volume,
+                             false,
+                             PGC_POSTMASTER,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomBoolVariable("logerrors.track_times",
+                             "Keep times of first and last message of each key in each interval",
+                             NULL,
+                             &track_times,
+                             false,
+                             PGC_POSTMASTER,
+                             0,
+                             NULL,
+                             NULL,
+                             NULL);
+    DefineCustomIntVariable("logerrors.max_memory",
+                            "Memory for message keys and their counters",
+                            "Default of 32MB, new keys are not counted when it is exhausted",
+                            &max_memory,
+                            32 * 1024,
+                            1024,
+                            MAX_KILOBYTES,
+                            PGC_POSTMASTER,
+                            GUC_UNIT_KB | GUC_NO_RESET_ALL,
+                            NULL,
+                            NULL,
+                            NULL);
+}
+
+static Size
+logerrors_memsize(void)
+{
+    Size size;
+    size = mul_size(sizeof(ErrorCode) + sizeof(ErrorName), error_codes_count);
+    size = add_size(size, MAXALIGN(sizeof(GlobalInfo)));
+    size = add_size(size, dsa_place_size);
+    return size;
+}
+/*
+ * Entry point for worker loading
+ */
+void
+_PG_init(void)
+{
+    BackgroundWorker worker;
+    if (!process_shared_preload_libraries_in_progress) {
+        return;
+    }
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = logerrors_shmem_startup;
+    prev_emit_log_hook = emit_log_hook;
+    emit_log_hook = logerrors_emit_log_hook;
+    /* Plugin works in any order of loading, PL/pgSQL looks it up on every call */
+    plpgsql_plugin_var = (PLpgSQL_plugin **) find_rendezvous_variable("PLpgSQL_plugin");
+    prev_plpgsql_plugin = *plpgsql_plugin_var;
+    *plpgsql_plugin_var = &plfunction_plugin;
+    RegisterXactCallback(plfunction_xact_callback, NULL);
+    RegisterSubXactCallback(plfunction_subxact_callback, NULL);
+#if (PG_VERSION_NUM >= 150000)
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = logerrors_shmem_request;
+#else
+    RequestAddinShmemSpace(logerrors_memsize());
+#endif
+    /* Registration depends on logerrors.publish_database */
+    logerrors_load_params();
+    /* Worker parameter and registration */
+    MemSet(&worker, 0, sizeof(BackgroundWorker));
+    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
+    worker.bgw_start_time = BgWorkerStart_PostmasterStart;
+    /* Connected workers can't start before consistent state */
+    if (publish_database != NULL && publish_database[0] != '\0') {
+        worker.bgw_flags |= BGWORKER_BACKEND_DATABASE_CONNECTION;
+        worker.bgw_start_time = BgWorkerStart_ConsistentState;
+    }
+    snprintf(worker.bgw_name, BGW_MAXLEN, "%s", worker_name);
+    sprintf(worker.bgw_library_name, "logerrors");
+    sprintf(worker.bgw_function_name, "logerrors_main");
+    /* Wait 10 seconds for restart after crash */
+    worker.bgw_restart_time = 10;
+    worker.bgw_main_arg = (Datum) 0;
+    worker.bgw_notify_pid = 0;
+    RegisterBackgroundWorker(&worker);
+}
+
+void
+_PG_fini(void)
+{
+    emit_log_hook = prev_emit_log_hook;
+    shmem_startup_hook = prev_shmem_startup_hook;
+    if (plpgsql_plugin_var != NULL)
+        *plpgsql_plugin_var = prev_plpgsql_plugin;
+}
+
+static void
+logerrors_shmem_startup(void) {
+    bool found;
+    int i;
+    HASHCTL ctl;
+    if (prev_shmem_startup_hook)
+        prev_shmem_startup_hook();
+    error_names_hashtable = NULL;
+    global_variables = NULL;
+    dsa_place = NULL;
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(ErrorCode);
+    ctl.entrysize = sizeof(ErrorName);
+    error_names_hashtable = ShmemInitHash("logerrors hash",
+                                          error_codes_count, error_codes_count,
+                                          &ctl,
+                                          HASH_ELEM | HASH_BLOBS);
+    global_variables = ShmemInitStruct("logerrors global_variables",
+                                       sizeof(GlobalInfo),
+                                       &found);
+    dsa_place = ShmemInitStruct("logerrors dsa",
+                                dsa_place_size,
+                                &found);
+    if (!IsUnderPostmaster) {
+        memset(global_variables, 0, sizeof(GlobalInfo));
+        LWLockInitialize(&global_variables->messagesBuffer.lock, LWLockNewTrancheId());
+        pg_atomic_init_u32(&global_variables->messagesBuffer.keys_count, 0);
+        pg_atomic_init_u64(&global_variables->messagesBuffer.dropped_count, 0);
+        pg_atomic_init_u32(&global_variables->messagesBuffer.client_keys_count, 0);
+        pg_atomic_init_u32(&global_variables->messagesBuffer.names_count, 0);
+        pg_atomic_init_u32(&global_variables->messagesBuffer.names_generation, 0);
+        SpinLockInit(&global_variables->suspects_lock);
+        SpinLockInit(&global_variables->slow_top_lock);
+        pg_atomic_init_u32(&global_variables->waiters_count, 0);
+        for (i = 0; i < max_error_waiters; ++i)
+            pg_atomic_init_u32(&global_variables->wait_thresholds[i], 0);
+        for (i = 0; i < max_actual_intervals_count; ++i) {
+            pg_atomic_init_u64(&global_variables->sampled_counts[i], 0);
+            pg_atomic_init_u64(&global_variables->sampled_variance[i], 0);
+            pg_atomic_init_u32(&global_variables->interval_fill[i], 0);
+        }
+        ConditionVariableInit(&global_variables->wait_cv);
+        pg_atomic_init_u32(&global_variables->urgent_pending, 0);
+        pg_atomic_init_u32(&global_variables->urgent_errcode, 0);
+        pg_atomic_init_u32(&global_variables->urgent_elevel, 0);
+        pg_atomic_init_u32(&global_variables->urgent_count, 0);
+        global_variables->publish_unavailable = false;
+        global_variables_init();
+        urgent_errcodes_init();
+        logerrors_dsa_init();
+        logerrors_init();
+    }
+    return;
+}
+
+#if (PG_VERSION_NUM >= 150000)
+/*
+ * Requests any additional shared memory required for our extension
+ */
+static void
+logerrors_shmem_request(void)
+{
+    if (prev_shmem_request_hook)
+        prev_shmem_request_hook();
+
+    RequestAddinShmemSpace(logerrors_memsize());
+}
+#endif
+
+PG_FUNCTION_INFO_V1(pg_log_errors_stats);
+
+/*
+ * sums[slot] += counts[slot] for slots below slots_count. Counters of interval
+ * are contiguous, so they are loaded by vectors: aligned 32-bit loads don't
+ * tear, which is all pg_atomic_read_u32() gives too.
+ */
+static void
+add_interval_counts(uint32 *sums, pg_atomic_uint32 *counts, uint32 slots_count)
+{
+    uint32 i = 0;
+#ifdef PG_HAVE_ATOMIC_U32_SIMULATION
+    for (; i < slots_count; ++i)
+        sums[i] += pg_atomic_read_u32(&counts[i]);
+#else
+    const uint32 *values = (const uint32 *) counts;
+#if defined(__AVX2__)
+    for (; i + 8 <= slots_count; i += 8)
+        _mm256_storeu_si256((__m256i *) &sums[i],
+                            _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &sums[i]),
+                                             _mm256_loadu_si256((const __m256i *) &values[i])));
+#elif defined(__SSE2__)
+    for (; i + 4 <= slots_count; i += 4)
+        _mm_storeu_si128((__m128i *) &sums[i],
+                         _mm_add_epi32(_mm_loadu_si128((const __m128i *) &sums[i]),
+                                       _mm_loadu_si128((const __m128i *) &values[i])));
+#endif
+    for (; i < slots_count; ++i)
+        sums[i] += values[i];
+#endif
+}
+
+/*
+ * Sum counters of chunk starting at id base over last duration_in_intervals
+ * closed intervals. Empty intervals and slots above fill of interval are not
+ * read. Returns false if no interval of window reaches the chunk.
+ */
+static bool
+sum_chunk_window(KeyChunk *chunk, uint32 base, uint32 keys_count, int duration_in_intervals,
+                 int current_interval, uint32 *sums) {
+    int i;
+    int interval_index;
+    uint32 fill;
+    bool reached = false;
+    memset(sums, 0, sizeof(uint32) * keys_per_chunk);
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        fill = Min(pg_atomic_read_u32(&global_variables->interval_fill[interval_index]), keys_count);
+        if (fill <= base)
+            continue;
+        add_interval_counts(sums, &chunk->counts[interval_index * keys_per_chunk], Min(fill - base, keys_per_chunk));
+        reached = true;
+    }
+    return reached;
+}
+
+/* Bit per slot of chunk with non-zero sum */
+static void
+mark_nonzero_sums(const uint32 *sums, uint64 *nonzero) {
+    uint32 i = 0;
+    memset(nonzero, 0, sizeof(uint64) * (keys_per_chunk / 64));
+#if defined(__AVX2__)
+    for (; i < keys_per_chunk; i += 8)
+        nonzero[i / 64] |= (uint64) (~_mm256_movemask_ps(_mm256_castsi256_ps(
+                _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *) &sums[i]), _mm256_setzero_si256()))) & 0xFF)
+                << (i % 64);
+#elif defined(__SSE2__)
+    for (; i < keys_per_chunk; i += 4)
+        nonzero[i / 64] |= (uint64) (~_mm_movemask_ps(_mm_castsi128_ps(
+                _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) &sums[i]), _mm_setzero_si128()))) & 0xF)
+                << (i % 64);
+#endif
+    for (; i < keys_per_chunk; ++i)
+        if (sums[i] != 0)
+            nonzero[i / 64] |= (uint64) 1 << (i % 64);
+}
+
+/*
+ * Free ids of keys without messages in the whole buffer and put them to free
+ * list, so that keys of high-cardinality dimensions don't fill the table for
+ * good. Scan is a pass over all counters, so it runs only when table is
+ * getting full. Counters are changed under lock of key entry, count checked
+ * under exclusive lock of entry stays zero until entry is deleted.
+ * Caller holds messagesBuffer.lock exclusively.
+ */
+static void
+reclaim_idle_keys(uint32 keys_count)
+{
+    MessagesBuffer *mb = &global_variables->messagesBuffer;
+    uint32 sums[keys_per_chunk];
+    uint64 nonzero[keys_per_chunk / 64];
+    uint32 base;
+    uint32 slot;
+    uint32 id;
+    int i;
+    bool idle;
+    KeyChunk *chunk;
+    KeyEntry *entry;
+
+    if ((uint64) (keys_count - mb->free_count) * 100 < (uint64) mb->max_keys * reclaim_keys_percent)
+        return;
+    for (base = 0; base < keys_count; base += keys_per_chunk) {
+        chunk = get_key_chunk(base);
+        /* Window of all intervals ending with current one is the whole buffer */
+        if (sum_chunk_window(chunk, base, keys_count, global_variables->actual_intervals_count,
+                             mb->current_interval_index, sums))
+            mark_nonzero_sums(sums, nonzero);
+        else
+            memset(nonzero, 0, sizeof(nonzero));
+        for (slot = 0; slot < keys_per_chunk && base + slot < keys_count; ++slot) {
+            if ((nonzero[slot / 64] & ((uint64) 1 << (slot % 64))) != 0 || chunk->is_free[slot])
+                continue;
+            id = base + slot;
+            entry = dshash_find(keys_table, &chunk->keys[slot], true);
+            if (entry == NULL)
+                continue;
+            idle = entry->id == id;
+            for (i = 0; idle && i < global_variables->actual_intervals_count; ++i)
+                idle = pg_atomic_read_u32(&chunk->counts[i * keys_per_chunk + slot]) == 0;
+            if (!idle) {
+                dshash_release_lock(keys_table, entry);
+                continue;
+            }
+            dshash_delete_entry(keys_table, entry);
+            if (chunk->keys[slot].client_id != 0)
+                pg_atomic_fetch_sub_u32(&mb->client_keys_count, 1);
+            chunk->is_free[slot] = true;
+            chunk->next_free[slot] = mb->free_head;
+            mb->free_head = id;
+            mb->free_count++;
+            mb->reclaimed_count++;
+        }
+    }
+}
+
+/* First and last message of key over last duration_in_intervals closed intervals, 0 if none */
+static void
+get_key_seen_times(KeyChunk *chunk, uint32 slot, int duration_in_intervals, int current_interval,
+                   TimestampTz *first_seen, TimestampTz *last_seen) {
+    int i;
+    int interval_index;
+    TimestampTz seen;
+    *first_seen = 0;
+    *last_seen = 0;
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        seen = (TimestampTz) pg_atomic_read_u64(&get_chunk_first_seen(chunk)[interval_index * keys_per_chunk + slot]);
+        if (seen != 0 && (*first_seen == 0 || seen < *first_seen))
+            *first_seen = seen;
+        seen = (TimestampTz) pg_atomic_read_u64(&get_chunk_last_seen(chunk)[interval_index * keys_per_chunk + slot]);
+        if (seen > *last_seen)
+            *last_seen = seen;
+    }
+}
+
+/* Bytes of key over last duration_in_intervals closed intervals */
+static uint64
+get_key_bytes(KeyChunk *chunk, uint32 slot, int duration_in_intervals, int current_interval) {
+    int i;
+    int interval_index;
+    uint64 bytes = 0;
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        bytes += pg_atomic_read_u64(&get_chunk_bytes(chunk)[interval_index * keys_per_chunk + slot]);
+    }
+    return bytes;
+}
+
+/*
+ * Sum counters over last duration_in_intervals closed intervals grouped by projected keys.
+ * Callers output projected keys in order of their first id, see order_counted_keys().
+ */
+static HTAB*
+count_up_errors(int current_interval, int duration_in_intervals, uint32 keys_count, project_key_function project) {
+    HASHCTL ctl;
+    HTAB* counters_hashtable;
+    bool found;
+    uint32 base;
+    uint32 slot;
+    uint32 counter;
+    uint32 sums[keys_per_chunk];
+    uint64 nonzero[keys_per_chunk / 64];
+    uint64 bits;
+    int word;
+    MessageInfo key;
+    KeyChunk *chunk;
+    CounterHashElem* elem;
+    TimestampTz first_seen = 0;
+    TimestampTz last_seen = 0;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(MessageInfo);
+    ctl.entrysize = sizeof(CounterHashElem);
+    /* an unshared hashtable can be expanded on-the-fly */
+    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM | HASH_BLOBS);
+    for (base = 0; base < keys_count; base += keys_per_chunk) {
+        chunk = get_key_chunk(base);
+        if (!sum_chunk_window(chunk, base, keys_count, duration_in_intervals, current_interval, sums))
+            continue;
+        mark_nonzero_sums(sums, nonzero);
+        /* Keys are visited in order of ids */
+        for (word = 0; word < keys_per_chunk / 64; ++word) {
+            for (bits = nonzero[word]; bits != 0; bits &= bits - 1) {
+                slot = word * 64 + pg_rightmost_one_pos64(bits);
+                counter = sums[slot];
+                key = chunk->keys[slot];
+                if (!project(&key))
+                    continue;
+                if (global_variables->messagesBuffer.track_times)
+                    get_key_seen_times(chunk, slot, duration_in_intervals, current_interval, &first_seen, &last_seen);
+                elem = hash_search(counters_hashtable, (void *) &key, HASH_ENTER, &found);
+                if (!found) {
+                    elem->counter = 0;
+                    elem->first_id = base + slot;
+                    elem->first_seen = 0;
+                    elem->last_seen = 0;
+                }
+                elem->counter += counter;
+                if (first_seen != 0 && (elem->first_seen == 0 || first_seen < elem->first_seen))
+                    elem->first_seen = first_seen;
+                if (last_seen > elem->last_seen)
+                    elem->last_seen = last_seen;
+            }
+        }
+    }
+    return counters_hashtable;
+}
+
+static int
+compare_first_ids(const void *a, const void *b)
+{
+    uint32 ia = ((const CounterHashElem *) a)->first_id;
+    uint32 ib = ((const CounterHashElem *) b)->first_id;
+    if (ia == ib)
+        return 0;
+    return ia < ib ? -1 : 1;
+}
+
+/*
+ * Counted keys in order of their first id, without another pass over all ids.
+ * Hashtable is destroyed. Returns palloc'd array of *counted_count elements.
+ */
+static CounterHashElem*
+order_counted_keys(HTAB* counters_hashtable, int *counted_count) {
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+    CounterHashElem *counted;
+
+    counted = palloc(sizeof(CounterHashElem) * (hash_get_num_entries(counters_hashtable) + 1));
+    *counted_count = 0;
+    hash_seq_init(&hash_seq, counters_hashtable);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL)
+        counted[(*counted_count)++] = *elem;
+    hash_destroy(counters_hashtable);
+    qsort(counted, *counted_count, sizeof(CounterHashElem), compare_first_ids);
+    return counted;
+}
+
+/* pg_log_errors_stats() shows type, error code, user and database */
+static bool
+project_stats_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->message_type_index >= message_types_count)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.db_oid = key->db_oid;
+    projected.user_oid = key->user_oid;
+    projected.message_type_index = key->message_type_index;
+    *key = projected;
+    return true;
+}
+
+static void
+put_values_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define logerrors_COLS	9
+    Datum long_interval_values[logerrors_COLS];
+    bool long_interval_nulls[logerrors_COLS];
+    bool found;
+    int i;
+    int k;
+    int counted_count;
+    char* db_name;
+    char* user_name;
+    char err_name_str[100];
+    ErrorName* err_name;
+    ErrorCode err_code;
+    CounterHashElem *counted;
+    CounterHashElem *elem;
+    if (global_variables == NULL){
+        return;
+    }
+    counted = order_counted_keys(count_up_errors(current_interval_index, duration_in_intervals, keys_count,
+                                                 project_stats_key), &counted_count);
+    for (i = 0; i < counted_count; ++i) {
+        elem = &counted[i];
+        MemSet(long_interval_values, 0, sizeof(long_interval_values));
+        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
+        for (k = 0; k < logerrors_COLS; ++k) {
+            long_interval_nulls[k] = false;
+        }
+        /* Time interval */
+        long_interval_values[0] = DatumGetInt32(global_variables->interval * duration_in_intervals / 1000);
+        /* Type */
+        long_interval_values[1] = CStringGetTextDatum(message_type_names[elem->key.message_type_index]);
+        /* Message */
+        err_code.num = elem->key.error_code;
+        err_name = hash_search(error_names_hashtable, (void *) &err_code, HASH_FIND, &found);
+        if (found)
+            long_interval_values[2] = CStringGetTextDatum(err_name->name);
+        else {
+            sprintf(err_name_str, "NOT_KNOWN_ERROR");
+            long_interval_values[2] = CStringGetTextDatum(err_name_str);
+        }
+        /* Count */
+        long_interval_values[3] = DatumGetInt32(elem->counter);
+        /* Username */
+        user_name = get_user_by_oid(elem->key.user_oid);
+        if (user_name == NULL)
+            long_interval_nulls[4] = true;
+        else
+            long_interval_values[4] = CStringGetTextDatum(user_name);
+        /* Database name */
+        db_name = get_database_name(elem->key.db_oid);
+        if (db_name == NULL)
+            long_interval_nulls[5] = true;
+        else
+            long_interval_values[5] = CStringGetTextDatum(db_name);
+
+        /* SQLState */
+        long_interval_values[6] = CStringGetTextDatum(unpack_sql_state(err_code.num));
+        /* First and last message */
+        if (elem->first_seen == 0) {
+            long_interval_nulls[7] = true;
+            long_interval_nulls[8] = true;
+        } else {
+            long_interval_values[7] = TimestampTzGetDatum(elem->first_seen);
+            long_interval_values[8] = TimestampTzGetDatum(elem->last_seen);
+        }
+
+        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+    }
+    pfree(counted);
+}
+
+
+Datum
+pg_log_errors_stats(PG_FUNCTION_ARGS)
+{
+#define logerrors_COLS	9
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    MemoryContext per_query_ctx;
+    MemoryContext oldcontext;
+    Datum long_interval_values[logerrors_COLS];
+
+    bool long_interval_nulls[logerrors_COLS];
+    int current_interval_index;
+    uint32 keys_count;
+    int lvl_i;
+    int j;
+    /* Shmem structs not ready yet */
+    if (error_names_hashtable == NULL || global_variables == NULL || !logerrors_attach_dsa()) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    /* check to see if caller supports us returning a tuplestore */
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("materialize mode required, but it is not allowed in this context")));
+
+    /* Build a tuple descriptor for our result type */
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
+    current_interval_index = global_variables->messagesBuffer.current_interval_index;
+    keys_count = pg_atomic_read_u32(&global_variables->messagesBuffer.keys_count);
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+    /* 'TOTAL' counters */
+    for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i) {
+
+        /* Add total count to result */
+        MemSet(long_interval_values, 0, sizeof(long_interval_values));
+        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
+        for (j = 0; j < logerrors_COLS; ++j) {
+            long_interval_nulls[j] = false;
+        }
+        /* Time interval */
+        long_interval_nulls[0] = true;
+        /* Type */
+        long_interval_values[1] = CStringGetTextDatum(message_type_names[lvl_i]);
+        /* Message */
+        long_interval_values[2] = CStringGetTextDatum("TOTAL");
+        /* Count */
+        long_interval_values[3] = DatumGetInt32(pg_atomic_read_u32(&global_variables->total_count[lvl_i]));
+        /* Username */
+        long_interval_nulls[4] = true;
+        /* Database name */
+        long_interval_nulls[5] = true;
+        /* sqlstate */
+        long_interval_nulls[6] = true;
+        /* First and last message */
+        long_interval_nulls[7] = true;
+        long_interval_nulls[8] = true;
+        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
+    }
+    /* short interval counters */
+    put_values_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+    /* long interval counters */
+    put_values_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                        tupstore);
+    /* return the tuplestore */
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_reset);
+
+Datum
+pg_log_errors_reset(PG_FUNCTION_ARGS) {
+
+    if (error_names_hashtable == NULL || global_variables == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+
+    logerrors_init();
+    logerrors_reset_keys();
+
+    PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_stats);
+
+Datum
+pg_slow_log_stats(PG_FUNCTION_ARGS)
+{
+#define SLOW_LOG_COLS 2
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    Tuplestorestate *tupstore;
+    TupleDesc tupdesc;
+    MemoryContext per_query_ctx;
+    MemoryContext oldcontext;
+    int i;
+
+    Datum result_values[SLOW_LOG_COLS];
+    bool result_nulls[SLOW_LOG_COLS];
+
+    /* Shmem structs not ready yet */
+    if (global_variables == NULL) {
+        return (Datum) 0;
+    }
+    /* check to see if caller supports us returning a tuplestore */
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("materialize mode required, but it is not allowed in this context")));
+
+    /* Build a tuple descriptor for our result type */
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+
+    MemSet(result_values, 0, sizeof(result_values));
+    MemSet(result_nulls, 0, sizeof(result_nulls));
+    for (i = 0; i < SLOW_LOG_COLS; i++) {
+        result_nulls[i] = false;
+    }
+    result_values[0] = DatumGetInt32(pg_atomic_read_u32(&global_variables->slow_log_info.count));
+    result_values[1] = DatumGetTimestamp(pg_atomic_read_u64(&global_variables->slow_log_info.reset_time));
+
+    tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
+    /* return the tuplestore */
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_capacity);
+
+Datum
+pg_log_errors_capacity(PG_FUNCTION_ARGS)
+{
+#define CAPACITY_COLS 5
+    MessagesBuffer *mb;
+    TupleDesc tupdesc;
+    Datum values[CAPACITY_COLS];
+    bool nulls[CAPACITY_COLS];
+
+    if (global_variables == NULL) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    mb = &global_variables->messagesBuffer;
+    MemSet(nulls, 0, sizeof(nulls));
+    LWLockAcquire(&mb->lock, LW_SHARED);
+    /* Keys in use */
+    values[0] = Int32GetDatum(pg_atomic_read_u32(&mb->keys_count) - mb->free_count);
+    /* Max keys */
+    values[1] = Int32GetDatum(mb->max_keys);
+    /* Dropped */
+    values[2] = Int64GetDatum(pg_atomic_read_u64(&mb->dropped_count));
+    /* Reclaimed */
+    values[3] = Int64GetDatum(mb->reclaimed_count);
+    /* Warning */
+    if (mb->capacity_warning)
+        values[4] = CStringGetTextDatum("key table is almost full even after freeing idle keys, increase logerrors.max_memory");
+    else
+        nulls[4] = true;
+    LWLockRelease(&mb->lock);
+    PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/* Count of last closed intervals covering window of seconds, limited by the buffer */
+static int
+window_to_intervals(int32 seconds)
+{
+    int64 window_intervals;
+
+    if (seconds <= 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("window_seconds must be positive")));
+    window_intervals = (int64) seconds * 1000 / global_variables->interval;
+    window_intervals = Max(window_intervals, 1);
+    return (int) Min(window_intervals, (int64) global_variables->intervals_count);
+}
+
+/* Check that shared state is ready and caller accepts a tuplestore, set it up as result */
+static Tuplestorestate*
+init_result_tuplestore(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+    Tuplestorestate *tupstore;
+    MemoryContext per_query_ctx;
+    MemoryContext oldcontext;
+
+    if (global_variables == NULL || !logerrors_attach_dsa()) {
+        ereport(ERROR,
+                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+                        errmsg("logerrors must be loaded via shared_preload_libraries")));
+    }
+    /* check to see if caller supports us returning a tuplestore */
+    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("set-valued function called in context that cannot accept a set")));
+    if (!(rsinfo->allowedModes & SFRM_Materialize))
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("materialize mode required, but it is not allowed in this context")));
+
+    /* Build a tuple descriptor for our result type */
+    if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+        ereport(ERROR,
+                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                        errmsg("return type must be a row type")));
+
+    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+    tupstore = tuplestore_begin_heap(true, false, work_mem);
+    rsinfo->returnMode = SFRM_Materialize;
+    rsinfo->setResult = tupstore;
+    rsinfo->setDesc = *tupdesc;
+    MemoryContextSwitchTo(oldcontext);
+    return tupstore;
+}
+
+/* Current interval and count of keys visible to readers */
+static void
+get_buffer_state(int *current_interval_index, uint32 *keys_count)
+{
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_SHARED);
+    *current_interval_index = global_variables->messagesBuffer.current_interval_index;
+    *keys_count = pg_atomic_read_u32(&global_variables->messagesBuffer.keys_count);
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_relations);
+
+/*
+ * pg_log_errors_relations() shows relation, constraint and error code. Relation
+ * of lock and serialization failures is shown by pg_log_errors_contention().
+ */
+static bool
+project_relations_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if ((key->relation_id == 0 && key->constraint_id == 0) || is_contention_errcode(key->error_code))
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.relation_id = key->relation_id;
+    projected.constraint_id = key->constraint_id;
+    *key = projected;
+    return true;
+}
+
+static void
+put_relations_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define RELATIONS_COLS	5
+    Datum values[RELATIONS_COLS];
+    bool nulls[RELATIONS_COLS];
+    int i;
+    int counted_count;
+    NameKey *name;
+    CounterHashElem *counted;
+    CounterHashElem *elem;
+
+    counted = order_counted_keys(count_up_errors(current_interval_index, duration_in_intervals, keys_count,
+                                                 project_relations_key), &counted_count);
+    for (i = 0; i < counted_count; ++i) {
+        elem = &counted[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Relation */
+        name = get_name_by_id(elem->key.relation_id);
+        if (name == NULL)
+            nulls[1] = true;
+        else
+            values[1] = CStringGetTextDatum(name->name);
+        /* Constraint */
+        name = get_name_by_id(elem->key.constraint_id);
+        if (name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(name->name);
+        /* SQLState */
+        values[3] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Count */
+        values[4] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(counted);
+}
+
+Datum
+pg_log_errors_relations(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    /* short interval counters */
+    put_relations_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+    /* long interval counters */
+    put_relations_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                           tupstore);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_locations);
+
+/* pg_log_errors_locations() shows type, source location and error code */
+static bool
+project_locations_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->location_id == 0)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.message_type_index = key->message_type_index;
+    projected.location_id = key->location_id;
+    projected.funcname_id = key->funcname_id;
+    *key = projected;
+    return true;
+}
+
+static void
+put_locations_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define LOCATIONS_COLS	7
+    Datum values[LOCATIONS_COLS];
+    bool nulls[LOCATIONS_COLS];
+    int i;
+    int counted_count;
+    NameKey *name;
+    char *lineno;
+    CounterHashElem *counted;
+    CounterHashElem *elem;
+
+    counted = order_counted_keys(count_up_errors(current_interval_index, duration_in_intervals, keys_count,
+                                                 project_locations_key), &counted_count);
+    for (i = 0; i < counted_count; ++i) {
+        elem = &counted[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Type */
+        values[1] = CStringGetTextDatum(message_type_names[elem->key.message_type_index]);
+        /* Function */
+        name = get_name_by_id(elem->key.funcname_id);
+        if (name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(name->name);
+        /* File and line, stored as "filename:lineno" */
+        name = get_name_by_id(elem->key.location_id);
+        lineno = name == NULL ? NULL : strrchr(name->name, ':');
+        if (lineno == NULL) {
+            nulls[3] = true;
+            nulls[4] = true;
+        } else {
+            values[3] = PointerGetDatum(cstring_to_text_with_len(name->name, lineno - name->name));
+            values[4] = Int32GetDatum(atoi(lineno + 1));
+        }
+        /* SQLState */
+        values[5] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Count */
+        values[6] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(counted);
+}
+
+Datum
+pg_log_errors_locations(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    /* short interval counters */
+    put_locations_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+    /* long interval counters */
+    put_locations_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                           tupstore);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_contention);
+
+/* pg_log_errors_contention() shows lock and serialization failures by relation, query, user and database */
+static bool
+project_contention_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->message_type_index >= message_types_count || !is_contention_errcode(key->error_code))
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.db_oid = key->db_oid;
+    projected.user_oid = key->user_oid;
+    projected.relation_id = key->relation_id;
+    projected.queryid = key->queryid;
+    *key = projected;
+    return true;
+}
+
+static int
+compare_counters_desc(const void *a, const void *b)
+{
+    uint32 ca = ((const CounterHashElem *) a)->counter;
+    uint32 cb = ((const CounterHashElem *) b)->counter;
+    if (ca == cb)
+        return 0;
+    return ca > cb ? -1 : 1;
+}
+
+/*
+ * Projected keys with counters over last duration_in_intervals closed intervals,
+ * most frequent first. Returns palloc'd array of *ranked_count elements.
+ */
+static CounterHashElem*
+rank_counted_keys(int current_interval_index, int duration_in_intervals, uint32 keys_count,
+                  project_key_function project, int *ranked_count)
+{
+    CounterHashElem *ranked;
+
+    ranked = order_counted_keys(count_up_errors(current_interval_index, duration_in_intervals, keys_count, project),
+                                ranked_count);
+    qsort(ranked, *ranked_count, sizeof(CounterHashElem), compare_counters_desc);
+    return ranked;
+}
+
+/* Relation name stored by get_contention_relation(), "#oid" is resolved in the same database only */
+static char*
+get_relation_name(NameKey *name, Oid db_oid)
+{
+    Oid relid;
+    char *relname;
+    char *nspname;
+    if (name == NULL)
+        return NULL;
+    if (name->name[0] != '#' || db_oid != MyDatabaseId)
+        return pstrdup(name->name);
+    relid = atooid(name->name + 1);
+    relname = get_rel_name(relid);
+    nspname = get_namespace_name(get_rel_namespace(relid));
+    if (relname == NULL || nspname == NULL)
+        return pstrdup(name->name);
+    return psprintf("%s.%s", nspname, relname);
+}
+
+static void
+put_contention_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define CONTENTION_COLS	7
+    Datum values[CONTENTION_COLS];
+    bool nulls[CONTENTION_COLS];
+    int i;
+    int ranked_count = 0;
+    char *name;
+    CounterHashElem *elem = NULL;
+    CounterHashElem *ranked;
+
+    ranked = rank_counted_keys(current_interval_index, duration_in_intervals, keys_count, project_contention_key,
+                               &ranked_count);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* SQLState */
+        values[1] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Relation */
+        name = get_relation_name(get_name_by_id(elem->key.relation_id), elem->key.db_oid);
+        if (name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(name);
+        /* Query id */
+        if (elem->key.queryid == 0)
+            nulls[3] = true;
+        else
+            values[3] = Int64GetDatum((int64) elem->key.queryid);
+        /* Username */
+        name = get_user_by_oid(elem->key.user_oid);
+        if (name == NULL)
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(name);
+        /* Database name */
+        name = get_database_name(elem->key.db_oid);
+        if (name == NULL)
+            nulls[5] = true;
+        else
+            values[5] = CStringGetTextDatum(name);
+        /* Count */
+        values[6] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+}
+
+Datum
+pg_log_errors_contention(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    /* short interval counters */
+    put_contention_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+    /* long interval counters */
+    put_contention_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                            tupstore);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_clients);
+
+/* pg_log_errors_clients() shows authentication failures by client address */
+static bool
+project_clients_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->client_id == 0)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.client_id = key->client_id;
+    *key = projected;
+    return true;
+}
+
+static void
+put_clients_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define CLIENTS_COLS	4
+    Datum values[CLIENTS_COLS];
+    bool nulls[CLIENTS_COLS];
+    int i;
+    int ranked_count = 0;
+    NameKey *name;
+    CounterHashElem *elem = NULL;
+    CounterHashElem *ranked;
+
+    ranked = rank_counted_keys(current_interval_index, duration_in_intervals, keys_count, project_clients_key,
+                               &ranked_count);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Client address */
+        name = get_name_by_id(elem->key.client_id);
+        if (name == NULL)
+            nulls[1] = true;
+        else
+            values[1] = CStringGetTextDatum(name->name);
+        /* SQLState */
+        values[2] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Count */
+        values[3] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+}
+
+/*
+ * Authentication failures by client address. Without arguments shows short and
+ * long windows, otherwise sums last window_seconds.
+ */
+Datum
+pg_log_errors_clients(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_clients_to_tuple(current_interval_index, window_intervals, keys_count, tupdesc, tupstore);
+    } else {
+        /* short interval counters */
+        put_clients_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+        /* long interval counters */
+        put_clients_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                             tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_statements);
+
+/* pg_log_errors_statements() shows messages by class of statement, type and error code */
+static bool
+project_statements_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->statement_class == 0)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.message_type_index = key->message_type_index;
+    projected.statement_class = key->statement_class;
+    *key = projected;
+    return true;
+}
+
+static void
+put_statements_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define STATEMENTS_COLS	5
+    Datum values[STATEMENTS_COLS];
+    bool nulls[STATEMENTS_COLS];
+    int i;
+    int ranked_count = 0;
+    CounterHashElem *elem = NULL;
+    CounterHashElem *ranked;
+
+    ranked = rank_counted_keys(current_interval_index, duration_in_intervals, keys_count, project_statements_key,
+                               &ranked_count);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Statement class */
+        values[1] = CStringGetTextDatum(statement_class_names[elem->key.statement_class]);
+        /* Type */
+        values[2] = CStringGetTextDatum(message_type_names[elem->key.message_type_index]);
+        /* SQLState */
+        values[3] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Count */
+        values[4] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+}
+
+/*
+ * Messages by class of statement raising them. Without arguments shows short
+ * and long windows, otherwise sums last window_seconds.
+ */
+Datum
+pg_log_errors_statements(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_statements_to_tuple(current_interval_index, window_intervals, keys_count, tupdesc, tupstore);
+    } else {
+        /* short interval counters */
+        put_statements_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+        /* long interval counters */
+        put_statements_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                                tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_plfunctions);
+
+/* pg_log_errors_plfunctions() shows PL/pgSQL function, database, type and error code */
+static bool
+project_plfunctions_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->plfunction_id == 0)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.db_oid = key->db_oid;
+    projected.message_type_index = key->message_type_index;
+    projected.plfunction_id = key->plfunction_id;
+    projected.plfunction_oid = key->plfunction_oid;
+    *key = projected;
+    return true;
+}
+
+static void
+put_plfunctions_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define PLFUNCTIONS_COLS	7
+    Datum values[PLFUNCTIONS_COLS];
+    bool nulls[PLFUNCTIONS_COLS];
+    int i;
+    int ranked_count = 0;
+    char *db_name;
+    NameKey *name;
+    CounterHashElem *elem = NULL;
+    CounterHashElem *ranked;
+
+    ranked = rank_counted_keys(current_interval_index, duration_in_intervals, keys_count, project_plfunctions_key,
+                               &ranked_count);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Function oid, DO blocks have none */
+        if (OidIsValid(elem->key.plfunction_oid))
+            values[1] = ObjectIdGetDatum(elem->key.plfunction_oid);
+        else
+            nulls[1] = true;
+        /* Function signature */
+        name = get_name_by_id(elem->key.plfunction_id);
+        if (name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(name->name);
+        /* Database name */
+        db_name = get_database_name(elem->key.db_oid);
+        if (db_name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(db_name);
+        /* Type */
+        values[4] = CStringGetTextDatum(message_type_names[elem->key.message_type_index]);
+        /* SQLState */
+        values[5] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Count */
+        values[6] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+}
+
+/*
+ * Messages by PL/pgSQL function or trigger function raising them. Without
+ * arguments shows short and long windows, otherwise sums last window_seconds.
+ */
+Datum
+pg_log_errors_plfunctions(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_plfunctions_to_tuple(current_interval_index, window_intervals, keys_count, tupdesc, tupstore);
+    } else {
+        /* short interval counters */
+        put_plfunctions_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+        /* long interval counters */
+        put_plfunctions_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                                 tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_suspects);
+
+Datum
+pg_log_errors_suspects(PG_FUNCTION_ARGS)
+{
+#define SUSPECTS_COLS	7
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    Datum values[SUSPECTS_COLS];
+    bool nulls[SUSPECTS_COLS];
+    RetrySuspect suspects[max_retry_suspects];
+    PGPROC *proc;
+    TimestampTz now = GetCurrentTimestamp();
+    char *name;
+    int i;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    SpinLockAcquire(&global_variables->suspects_lock);
+    memcpy(suspects, global_variables->suspects, sizeof(suspects));
+    SpinLockRelease(&global_variables->suspects_lock);
+
+    for (i = 0; i < max_retry_suspects; ++i) {
+        if (suspects[i].pid == 0 || TimestampDifferenceExceeds(suspects[i].last_time, now, retry_suspect_expire_ms))
+            continue;
+        /* Backend has exited, maybe its pid is reused */
+        proc = BackendPidGetProc(suspects[i].pid);
+        if (proc == NULL || proc->roleId != suspects[i].role_oid || proc->databaseId != suspects[i].db_oid)
+            continue;
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Pid */
+        values[0] = Int32GetDatum(suspects[i].pid);
+        /* Username */
+        name = get_user_by_oid(suspects[i].user_oid);
+        if (name == NULL)
+            nulls[1] = true;
+        else
+            values[1] = CStringGetTextDatum(name);
+        /* Database name */
+        name = get_database_name(suspects[i].db_oid);
+        if (name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(name);
+        /* Query id or hash of statement */
+        values[3] = Int64GetDatum((int64) suspects[i].statement_id);
+        /* SQLState */
+        values[4] = CStringGetTextDatum(unpack_sql_state(suspects[i].error_code));
+        /* Run length */
+        values[5] = Int64GetDatum((int64) suspects[i].run_length);
+        /* Last seen */
+        values[6] = TimestampTzGetDatum(suspects[i].last_time);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_db_ratio);
+
+/* Errors by database */
+static bool
+project_db_errors_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->message_type_index >= message_types_count ||
+        message_types_codes[key->message_type_index] != ERROR)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.db_oid = key->db_oid;
+    *key = projected;
+    return true;
+}
+
+static void
+put_db_ratio_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define DB_RATIO_COLS	7
+    Datum values[DB_RATIO_COLS];
+    bool nulls[DB_RATIO_COLS];
+    XactSample totals[max_sampled_databases];
+    int totals_count = 0;
+    XactSample *samples;
+    XactSample *sample;
+    int interval_index;
+    int i;
+    int j;
+    int k;
+    bool found;
+    char *db_name;
+    MessageInfo key;
+    uint32 errors;
+    HTAB* counters_hashtable;
+    CounterHashElem *elem;
+
+    if (!DsaPointerIsValid(global_variables->xact_samples))
+        return;
+    samples = (XactSample *) dsa_get_address(logerrors_dsa, global_variables->xact_samples);
+    MemSet(totals, 0, sizeof(totals));
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval_index - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        for (j = 0; j < max_sampled_databases; ++j) {
+            sample = &samples[interval_index * max_sampled_databases + j];
+            if (!OidIsValid(sample->db_oid))
+                break;
+            for (k = 0; k < totals_count; ++k) {
+                if (totals[k].db_oid == sample->db_oid)
+                    break;
+            }
+            if (k == totals_count) {
+                if (totals_count == max_sampled_databases)
+                    continue;
+                totals[totals_count++].db_oid = sample->db_oid;
+            }
+            totals[k].xact_commit += sample->xact_commit;
+            totals[k].xact_rollback += sample->xact_rollback;
+        }
+    }
+
+    counters_hashtable = count_up_errors(current_interval_index, duration_in_intervals, keys_count,
+                                         project_db_errors_key);
+    for (i = 0; i < totals_count; ++i) {
+        memset(&key, 0, sizeof(key));
+        key.db_oid = totals[i].db_oid;
+        elem = hash_search(counters_hashtable, (void *) &key, HASH_FIND, &found);
+        errors = found ? elem->counter : 0;
+        db_name = get_database_name(totals[i].db_oid);
+        if (db_name == NULL)
+            continue;
+
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Database name */
+        values[1] = CStringGetTextDatum(db_name);
+        /* Errors */
+        values[2] = Int64GetDatum(errors);
+        /* Commits */
+        values[3] = Int64GetDatum(totals[i].xact_commit);
+        /* Rollbacks */
+        values[4] = Int64GetDatum(totals[i].xact_rollback);
+        /* Errors per committed transaction */
+        if (totals[i].xact_commit == 0)
+            nulls[5] = true;
+        else
+            values[5] = Float8GetDatum((double) errors / totals[i].xact_commit);
+        /* Share of rolled back transactions */
+        if (totals[i].xact_commit + totals[i].xact_rollback == 0)
+            nulls[6] = true;
+        else
+            values[6] = Float8GetDatum((double) totals[i].xact_rollback /
+                                       (totals[i].xact_commit + totals[i].xact_rollback));
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    hash_destroy(counters_hashtable);
+}
+
+/*
+ * Errors and transactions by database. Without arguments shows short and
+ * long windows, otherwise sums last window_seconds.
+ */
+Datum
+pg_log_errors_db_ratio(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_db_ratio_to_tuple(current_interval_index, window_intervals, keys_count, tupdesc, tupstore);
+    } else {
+        /* short interval counters */
+        put_db_ratio_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+        /* long interval counters */
+        put_db_ratio_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                              tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_volume);
+
+/* pg_log_errors_volume() shows type, database, error code and message format */
+static void
+project_volume_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    memset(&projected, 0, sizeof(projected));
+    projected.error_code = key->error_code;
+    projected.db_oid = key->db_oid;
+    projected.message_type_index = key->message_type_index;
+    projected.format_id = key->format_id;
+    *key = projected;
+}
+
+static int
+compare_volume_desc(const void *a, const void *b)
+{
+    uint64 ba = ((const VolumeHashElem *) a)->bytes;
+    uint64 bb = ((const VolumeHashElem *) b)->bytes;
+    if (ba == bb)
+        return 0;
+    return ba > bb ? -1 : 1;
+}
+
+static void
+put_volume_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        uint32 keys_count,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define VOLUME_COLS	7
+    Datum values[VOLUME_COLS];
+    bool nulls[VOLUME_COLS];
+    HASHCTL ctl;
+    HTAB* volume_hashtable;
+    HASH_SEQ_STATUS hash_seq;
+    bool found;
+    uint32 base;
+    uint32 slot;
+    uint32 sums[keys_per_chunk];
+    uint64 nonzero[keys_per_chunk / 64];
+    uint64 bits;
+    int word;
+    int i;
+    int ranked_count = 0;
+    char *db_name;
+    NameKey *name;
+    MessageInfo key;
+    KeyChunk *chunk;
+    VolumeHashElem *elem;
+    VolumeHashElem *ranked;
+
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(MessageInfo);
+    ctl.entrysize = sizeof(VolumeHashElem);
+    volume_hashtable = hash_create("volume hashtable", 1, &ctl, HASH_ELEM | HASH_BLOBS);
+    /* Bytes are summed only for keys with messages */
+    for (base = 0; base < keys_count; base += keys_per_chunk) {
+        chunk = get_key_chunk(base);
+        if (!sum_chunk_window(chunk, base, keys_count, duration_in_intervals, current_interval_index, sums))
+            continue;
+        mark_nonzero_sums(sums, nonzero);
+        for (word = 0; word < keys_per_chunk / 64; ++word) {
+            for (bits = nonzero[word]; bits != 0; bits &= bits - 1) {
+                slot = word * 64 + pg_rightmost_one_pos64(bits);
+                key = chunk->keys[slot];
+                /* Slow statements are counted by their LOG messages */
+                if (key.message_type_index == slow_log_type_index)
+                    continue;
+                project_volume_key(&key);
+                elem = hash_search(volume_hashtable, (void *) &key, HASH_ENTER, &found);
+                if (!found) {
+                    elem->counter = 0;
+                    elem->bytes = 0;
+                }
+                elem->counter += sums[slot];
+                elem->bytes += get_key_bytes(chunk, slot, duration_in_intervals, current_interval_index);
+            }
+        }
+    }
+    ranked = palloc(sizeof(VolumeHashElem) * (hash_get_num_entries(volume_hashtable) + 1));
+    hash_seq_init(&hash_seq, volume_hashtable);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL)
+        ranked[ranked_count++] = *elem;
+    hash_destroy(volume_hashtable);
+    qsort(ranked, ranked_count, sizeof(VolumeHashElem), compare_volume_desc);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Type */
+        values[1] = CStringGetTextDatum(log_type_names[elem->key.message_type_index]);
+        /* Database name */
+        db_name = OidIsValid(elem->key.db_oid) ? get_database_name(elem->key.db_oid) : NULL;
+        if (db_name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(db_name);
+        /* SQLState */
+        values[3] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Message format */
+        name = get_name_by_id(elem->key.format_id);
+        if (name == NULL)
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(name->name);
+        /* Count */
+        values[5] = Int32GetDatum(elem->counter);
+        /* Bytes */
+        values[6] = Int64GetDatum(elem->bytes);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+}
+
+/*
+ * Bytes written to server log, largest first. Without arguments shows short and
+ * long windows, otherwise sums last window_seconds.
+ */
+Datum
+pg_log_errors_volume(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    if (!global_variables->messagesBuffer.track_volume) {
+        ereport(WARNING,
+                (errmsg("logerrors.track_volume is off, no bytes are counted")));
+        tuplestore_donestoring(tupstore);
+        return (Datum) 0;
+    }
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_volume_to_tuple(current_interval_index, window_intervals, keys_count, tupdesc, tupstore);
+    } else {
+        /* short interval counters */
+        put_volume_to_tuple(current_interval_index, 1, keys_count, tupdesc, tupstore);
+        /* long interval counters */
+        put_volume_to_tuple(current_interval_index, global_variables->intervals_count, keys_count, tupdesc,
+                            tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_novel);
+
+/* Errors never seen before, newest first */
+Datum
+pg_log_errors_novel(PG_FUNCTION_ARGS)
+{
+#define NOVEL_COLS	6
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    Datum values[NOVEL_COLS];
+    bool nulls[NOVEL_COLS];
+    NovelError *novel_errors;
+    NovelError *novel;
+    uint64 next;
+    int count;
+    int i;
+    char *user_name;
+    char *db_name;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    novel_errors = palloc(sizeof(global_variables->novel_errors));
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_SHARED);
+    next = global_variables->novel_errors_next;
+    memcpy(novel_errors, global_variables->novel_errors, sizeof(global_variables->novel_errors));
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+
+    count = (int) Min(next, max_novel_errors);
+    for (i = 1; i <= count; ++i) {
+        novel = &novel_errors[(next - i) % max_novel_errors];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* First seen */
+        values[0] = TimestampTzGetDatum(novel->first_seen);
+        /* Type */
+        values[1] = CStringGetTextDatum(message_type_names[novel->message_type_index]);
+        /* SQLState */
+        values[2] = CStringGetTextDatum(unpack_sql_state(novel->error_code));
+        /* Username */
+        user_name = get_user_by_oid(novel->user_oid);
+        if (user_name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(user_name);
+        /* Database name */
+        db_name = get_database_name(novel->db_oid);
+        if (db_name == NULL)
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(db_name);
+        /* Message format */
+        if (novel->message[0] == '\0')
+            nulls[5] = true;
+        else
+            values[5] = CStringGetTextDatum(novel->message);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(novel_errors);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_log_errors_anomalies);
+
+/* Intervals with count of key far above its usual level, newest first */
+Datum
+pg_log_errors_anomalies(PG_FUNCTION_ARGS)
+{
+#define ANOMALIES_COLS	9
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    Datum values[ANOMALIES_COLS];
+    bool nulls[ANOMALIES_COLS];
+    Anomaly *anomalies;
+    Anomaly *anomaly;
+    uint64 next;
+    int count;
+    int i;
+    char *user_name;
+    char *db_name;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    anomalies = palloc(sizeof(global_variables->anomalies));
+    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_SHARED);
+    next = global_variables->anomalies_next;
+    memcpy(anomalies, global_variables->anomalies, sizeof(global_variables->anomalies));
+    LWLockRelease(&global_variables->messagesBuffer.lock);
+
+    count = (int) Min(next, max_anomalies);
+    for (i = 1; i <= count; ++i) {
+        anomaly = &anomalies[(next - i) % max_anomalies];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Detected at */
+        values[0] = TimestampTzGetDatum(anomaly->detected_at);
+        /* Type */
+        values[1] = CStringGetTextDatum(log_type_names[anomaly->key.message_type_index]);
+        /* SQLState */
+        values[2] = CStringGetTextDatum(unpack_sql_state(anomaly->key.error_code));
+        /* Username */
+        user_name = get_user_by_oid(anomaly->key.user_oid);
+        if (user_name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(user_name);
+        /* Database name */
+        db_name = get_database_name(anomaly->key.db_oid);
+        if (db_name == NULL)
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(db_name);
+        /* Count in flagged interval */
+        values[5] = Int32GetDatum(anomaly->count);
+        /* Usual level */
+        values[6] = Float8GetDatum(anomaly->mean);
+        values[7] = Float8GetDatum(anomaly->stddev);
+        /* Score in standard deviations */
+        values[8] = Float8GetDatum(anomaly->score);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(anomalies);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_stats_window);
+
+/* pg_slow_log_stats(window_seconds) shows database, user, application and query */
+static bool
+project_slow_log_key(MessageInfo *key)
+{
+    MessageInfo projected;
+    if (key->message_type_index != slow_log_type_index)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.db_oid = key->db_oid;
+    projected.user_oid = key->user_oid;
+    projected.application_id = key->application_id;
+    projected.queryid = key->queryid;
+    *key = projected;
+    return true;
+}
+
+/* Slow statements over last window_seconds, most frequent first */
+Datum
+pg_slow_log_stats_window(PG_FUNCTION_ARGS)
+{
+#define SLOW_LOG_WINDOW_COLS	6
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    Datum values[SLOW_LOG_WINDOW_COLS];
+    bool nulls[SLOW_LOG_WINDOW_COLS];
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+    int i;
+    int ranked_count = 0;
+    char *db_name;
+    char *user_name;
+    NameKey *name;
+    CounterHashElem *elem = NULL;
+    CounterHashElem *ranked;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+    window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+
+    ranked = rank_counted_keys(current_interval_index, window_intervals, keys_count, project_slow_log_key,
+                               &ranked_count);
+
+    for (i = 0; i < ranked_count; ++i) {
+        elem = &ranked[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * window_intervals / 1000);
+        /* Database name */
+        db_name = get_database_name(elem->key.db_oid);
+        if (db_name == NULL)
+            nulls[1] = true;
+        else
+            values[1] = CStringGetTextDatum(db_name);
+        /* Username */
+        user_name = get_user_by_oid(elem->key.user_oid);
+        if (user_name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(user_name);
+        /* Application name */
+        name = get_name_by_id(elem->key.application_id);
+        if (name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(name->name);
+        /* Query id */
+        if (elem->key.queryid == 0)
+            nulls[4] = true;
+        else
+            values[4] = Int64GetDatum((int64) elem->key.queryid);
+        /* Count */
+        values[5] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(ranked);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
+
+PG_FUNCTION_INFO_V1(pg_slow_log_top);
+
+static int
+compare_slow_statements_desc(const void *a, const void *b)
+{
+    double da = ((const SlowStatement *) a)->duration;
+    double db = ((const SlowStatement *) b)->duration;
+    if (da == db)
+        return 0;
+    return da > db ? -1 : 1;
+}
+
+static void
+put_slow_top_to_tuple(
+        int current_interval_index,
+        int duration_in_intervals,
+        TupleDesc tupdesc,
+        Tuplestorestate *tupstore){
+#define SLOW_TOP_COLS	7
+    Datum values[SLOW_TOP_COLS];
+    bool nulls[SLOW_TOP_COLS];
+    SlowTop *tops;
+    SlowStatement *statements;
+    SlowStatement *statement;
+    int statements_count = 0;
+    int interval_index;
+    int i;
+    char *db_name;
+    char *user_name;
+    bool read_all_stats;
+
+    if (!DsaPointerIsValid(global_variables->slow_top))
+        return;
+    /* Query text of other users is shown like in pg_stat_activity */
+#if (PG_VERSION_NUM >= 140000)
+    read_all_stats = has_privs_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS);
+#else
+    read_all_stats = is_member_of_role(GetUserId(), DEFAULT_ROLE_READ_ALL_STATS);
+#endif
+    tops = (SlowTop *) dsa_get_address(logerrors_dsa, global_variables->slow_top);
+    statements = palloc(sizeof(SlowStatement) * slow_top_count * duration_in_intervals);
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval_index - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        /* Lock is taken for one interval at a time to keep it short */
+        SpinLockAcquire(&global_variables->slow_top_lock);
+        memcpy(&statements[statements_count], tops[interval_index].statements,
+               sizeof(SlowStatement) * tops[interval_index].count);
+        statements_count += tops[interval_index].count;
+        SpinLockRelease(&global_variables->slow_top_lock);
+    }
+    qsort(statements, statements_count, sizeof(SlowStatement), compare_slow_statements_desc);
+
+    for (i = 0; i < Min(statements_count, slow_top_count); ++i) {
+        statement = &statements[i];
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time interval */
+        values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+        /* Duration (ms) */
+        values[1] = Float8GetDatum(statement->duration);
+        /* Seen at */
+        values[2] = TimestampTzGetDatum(statement->seen_at);
+        /* Database name */
+        db_name = get_database_name(statement->db_oid);
+        if (db_name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(db_name);
+        /* Username */
+        user_name = get_user_by_oid(statement->user_oid);
+        if (user_name == NULL)
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(user_name);
+        /* Query id */
+        if (statement->queryid == 0)
+            nulls[5] = true;
+        else
+            values[5] = Int64GetDatum((int64) statement->queryid);
+        /* Query, truncated */
+        if (read_all_stats || has_privs_of_role(GetUserId(), statement->user_oid))
+            values[6] = CStringGetTextDatum(statement->query);
+        else
+            values[6] = CStringGetTextDatum("<insufficient privilege>");
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(statements);
+}
+
+/*
+ * Slowest statements, slowest first. Without arguments shows short and
+ * long windows, otherwise last window_seconds.
+ */
+Datum
+pg_slow_log_top(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_slow_top_to_tuple(current_interval_index, window_intervals, tupdesc, tupstore);
+    } else {
+        /* short interval */
+        put_slow_top_to_tuple(current_interval_index, 1, tupdesc, tupstore);
+        /* long interval */
+        put_slow_top_to_tuple(current_interval_index, global_variables->intervals_count, tupdesc, tupstore);
+    }
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
 }
 
-static int
-create_file_if_not_exist(char* path)
+/* Mapping of logerrors.export_file, bgworker only */
+static LogerrorsExportHeader *export_map = NULL;
+
+/* Map export file, its layout is described in logerrors_export.h */
+static void
+export_open(void)
 {
-    struct stat stat_buff;
-    int flags = O_RDWR|O_APPEND;
+    char *path = export_file;
+    int fd;
+    void *map;
 
-    if (stat(path, &stat_buff) != 0)
-    {
-        if (errno != ENOENT)
-            return -1;
-        flags |= O_CREAT;
+    if (path == NULL || path[0] == '\0' || replace_pgdata_env(&path) == -1)
+        return;
+    fd = OpenTransientFile(path, O_RDWR | O_CREAT | PG_BINARY);
+    if (fd < 0) {
+        elog(WARNING, "logerrors: could not open file \"%s\": %m", path);
+        return;
     }
-    else
-    {
-        if (S_ISREG(stat_buff.st_mode) == 0)
-            return -1;
+    if (ftruncate(fd, LOGERRORS_EXPORT_FILE_SIZE) != 0) {
+        elog(WARNING, "logerrors: could not resize file \"%s\": %m", path);
+        CloseTransientFile(fd);
+        return;
     }
-    return OpenTransientFile(path, flags);
+    map = mmap(NULL, LOGERRORS_EXPORT_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CloseTransientFile(fd);
+    if (map == MAP_FAILED) {
+        elog(WARNING, "logerrors: could not map file \"%s\": %m", path);
+        return;
+    }
+    export_map = (LogerrorsExportHeader *) map;
+    /* Previous run may have died while writing */
+    if (export_map->sequence % 2 != 0)
+        export_map->sequence++;
 }
 
+/* Rewrite export file under seqlock with counters of short and long windows */
 static void
-write_line_to_stat_file(int fd)
+export_update(void)
 {
-    uint32 tmp[3] = {0};
-    char buf[256] = {0};
-    char timebuf[64] = {0};
-    char msbuf[8] = {0};
+    volatile LogerrorsExportHeader *header = export_map;
+    LogerrorsExportRecord *records;
+    LogerrorsExportRecord *record;
+    HTAB *short_counters;
+    HTAB *long_counters;
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+    CounterHashElem *short_elem;
+    int current_interval_index;
+    uint32 keys_count;
+    uint32 records_count = 0;
+    uint64 truncated = 0;
+    bool found;
     struct timeval tv;
-    pg_time_t sec;
 
-    Assert(sizeof(tmp) == sizeof(last_stats_counter));
+    if (header == NULL || !logerrors_attach_dsa())
+        return;
+    get_buffer_state(&current_interval_index, &keys_count);
+    short_counters = count_up_errors(current_interval_index, 1, keys_count, project_stats_key);
+    long_counters = count_up_errors(current_interval_index, global_variables->intervals_count, keys_count,
+                                    project_stats_key);
+    records = (LogerrorsExportRecord *) ((char *) export_map + sizeof(LogerrorsExportHeader));
 
+    header->sequence++;
+    pg_write_barrier();
+    hash_seq_init(&hash_seq, long_counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        if (records_count == LOGERRORS_EXPORT_MAX_RECORDS) {
+            truncated++;
+            continue;
+        }
+        record = &records[records_count++];
+        memset(record, 0, sizeof(*record));
+        strlcpy(record->sqlstate, unpack_sql_state(elem->key.error_code), sizeof(record->sqlstate));
+        strlcpy(record->type, message_type_names[elem->key.message_type_index], sizeof(record->type));
+        record->db_oid = elem->key.db_oid;
+        record->user_oid = elem->key.user_oid;
+        short_elem = hash_search(short_counters, (void *) &elem->key, HASH_FIND, &found);
+        record->short_count = found ? short_elem->counter : 0;
+        record->long_count = elem->counter;
+    }
+    header->magic = LOGERRORS_EXPORT_MAGIC;
+    header->version = LOGERRORS_EXPORT_VERSION;
+    header->header_size = sizeof(LogerrorsExportHeader);
+    header->record_size = sizeof(LogerrorsExportRecord);
     gettimeofday(&tv, NULL);
-    sec = (pg_time_t) tv.tv_sec;
-    pg_strftime(timebuf,
-                sizeof(timebuf),
-                "%Y-%m-%d %H:%M:%S        %Z",
-                pg_localtime(&sec, log_timezone));
-    sprintf(msbuf, ".%06d", (int) (tv.tv_usec));
-    strncpy(timebuf + 19, msbuf, 7);
-
-    tmp[0] = pg_atomic_read_u32(&global_variables->total_count[0]);
-    tmp[1] = pg_atomic_read_u32(&global_variables->total_count[1]);
-    tmp[2] = pg_atomic_read_u32(&global_variables->total_count[2]);
-
-    sprintf(buf, "%s,%d,%d,%d,0,0,0,0,0,0\n",
-            timebuf,
-            tmp[0]-last_stats_counter[0],
-            tmp[1]-last_stats_counter[1],
-            tmp[2]-last_stats_counter[2]);
+    header->updated_at = (int64) tv.tv_sec * 1000000 + tv.tv_usec;
+    header->interval_ms = global_variables->interval;
+    header->intervals_count = global_variables->intervals_count;
+    header->max_records = LOGERRORS_EXPORT_MAX_RECORDS;
+    header->records_count = records_count;
+    header->total_warning = pg_atomic_read_u32(&global_variables->total_count[0]);
+    header->total_error = pg_atomic_read_u32(&global_variables->total_count[1]);
+    header->total_fatal = pg_atomic_read_u32(&global_variables->total_count[2]);
+    header->total_slow = pg_atomic_read_u32(&global_variables->slow_log_info.count);
+    header->dropped = pg_atomic_read_u64(&global_variables->messagesBuffer.dropped_count);
+    header->truncated = truncated;
+    pg_write_barrier();
+    header->sequence++;
 
-    write(fd, buf, strlen(buf));
-    memcpy(last_stats_counter, tmp, sizeof(tmp));
+    hash_destroy(short_counters);
+    hash_destroy(long_counters);
 }
 
-void
-write_to_stat_file()
-{
-
-    char stats_path[256] = {0};
-    char log_path[256] = {0};
-    int fd = -1;
-
-    if (global_variables == NULL)
-        return;
+/* Socket sending interval deltas and its destination, bgworker only */
+static pgsocket push_fd = PGINVALID_SOCKET;
+static struct sockaddr_un push_addr;
+/* Intervals not delivered because receiver was absent or slow, reported with next delivered one */
+static uint64 push_dropped_intervals = 0;
 
-    Assert(stats_temp_directory);
-    if (replace_pgdata_env(&stats_temp_directory) == -1)
-        return;
-    remove_end_separator(stats_temp_directory);
+static void
+push_open(void)
+{
+    char *path = push_socket;
 
-    strcat(stats_path, stats_temp_directory);
-    strcat(stats_path, "/stats");
-    strcat(log_path, stats_temp_directory);
-    strcat(log_path, "/log");
-    if (create_dir_if_not_exist(stats_path, NULL, NULL) != 0)
+    if (path == NULL || path[0] == '\0' || replace_pgdata_env(&path) == -1)
         return;
-    if (create_dir_if_not_exist(log_path, NULL, NULL) != 0)
+    if (strlen(path) >= sizeof(push_addr.sun_path)) {
+        elog(WARNING, "logerrors: socket path \"%s\" is too long", path);
         return;
-
-    get_current_stats_file(stats_path);
-    fd = create_file_if_not_exist(stats_path);
-    if (fd < 0)
+    }
+    memset(&push_addr, 0, sizeof(push_addr));
+    push_addr.sun_family = AF_UNIX;
+    strlcpy(push_addr.sun_path, path, sizeof(push_addr.sun_path));
+    push_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (push_fd == PGINVALID_SOCKET) {
+        elog(WARNING, "logerrors: could not create socket: %m");
         return;
-    write_line_to_stat_file(fd);
-    CloseTransientFile(fd);
+    }
+    /* Rotation must never wait for receiver */
+    if (!pg_set_noblock(push_fd)) {
+        elog(WARNING, "logerrors: could not set socket to nonblocking mode: %m");
+        closesocket(push_fd);
+        push_fd = PGINVALID_SOCKET;
+    }
 }
 
+/* Send one datagram, false if receiver is absent or can't take it now */
+static bool
+push_send(StringInfo buf)
+{
+    if (buf->len == 0)
+        return true;
+    if (sendto(push_fd, buf->data, buf->len, 0, (struct sockaddr *) &push_addr, sizeof(push_addr)) < 0) {
+        /* EAGAIN and ENOBUFS mean receiver is slow, ENOENT and ECONNREFUSED that it is not running */
+        elog(DEBUG1, "logerrors: could not send to socket \"%s\": %m", push_addr.sun_path);
+        return false;
+    }
+    resetStringInfo(buf);
+    return true;
+}
 
-/* Log hook */
-void
-logerrors_emit_log_hook(ErrorData *edata)
+/*
+ * Send counters of the interval just closed as statsd counters with tags,
+ * lines are batched into datagrams of push_datagram_size at most. If receiver
+ * can't take a datagram the rest of interval is dropped.
+ */
+static void
+push_update(void)
 {
-    int lvl_i;
-    int err_code_index;
-    bool skip;
-    /* Only if hashtable already inited */
-    if (global_variables != NULL && MyProc != NULL && !proc_exit_inprogress && !got_sigterm) {
-        for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i)
-        {
-            /* Only current message type */
-            if (edata->elevel != message_types_codes[lvl_i])
-                continue;
-            skip = false;
-            for (err_code_index = 0; err_code_index < global_variables->excluded_errcodes_count; ++err_code_index) {
-                if (edata->sqlerrcode == global_variables->excluded_errcodes[err_code_index]) {
-                    skip = true;
-                    break;
-                }
+    StringInfoData buf;
+    char line[256];
+    char type[10];
+    HTAB *counters;
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+    int current_interval_index;
+    uint32 keys_count;
+    int i;
+    bool delivered = true;
+    /* First datagram carries count of dropped intervals */
+    bool first_sent = false;
+
+    if (push_fd == PGINVALID_SOCKET || !logerrors_attach_dsa())
+        return;
+    get_buffer_state(&current_interval_index, &keys_count);
+    counters = count_up_errors(current_interval_index, 1, keys_count, project_stats_key);
+    initStringInfo(&buf);
+    if (push_dropped_intervals > 0)
+        appendStringInfo(&buf, "logerrors.push_dropped_intervals:" UINT64_FORMAT "|c\n", push_dropped_intervals);
+    hash_seq_init(&hash_seq, counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        strlcpy(type, message_type_names[elem->key.message_type_index], sizeof(type));
+        for (i = 0; type[i] != '\0'; ++i)
+            type[i] = pg_ascii_tolower((unsigned char) type[i]);
+        snprintf(line, sizeof(line), "logerrors.%s.%s:%u|c|#db:%u,user:%u\n",
+                 type, unpack_sql_state(elem->key.error_code), elem->counter,
+                 elem->key.db_oid, elem->key.user_oid);
+        if (buf.len + strlen(line) > push_datagram_size) {
+            if (!push_send(&buf)) {
+                delivered = false;
+                hash_seq_term(&hash_seq);
+                break;
             }
-            if (skip)
-                continue;
-            add_message(edata->sqlerrcode, MyDatabaseId, GetUserId(), lvl_i);
-            pg_atomic_fetch_add_u32(&global_variables->total_count[lvl_i], 1);
-        }
-        if (edata && edata->message && strstr(edata->message, "duration:"))
-        {
-            pg_atomic_fetch_add_u32(&global_variables->slow_log_info.count, 1);
+            first_sent = true;
         }
+        appendStringInfoString(&buf, line);
     }
-
-    if (prev_emit_log_hook) {
-        prev_emit_log_hook(edata);
+    if (delivered) {
+        delivered = push_send(&buf);
+        first_sent = first_sent || delivered;
     }
+    if (first_sent)
+        push_dropped_intervals = 0;
+    if (!delivered)
+        push_dropped_intervals++;
+    pfree(buf.data);
+    hash_destroy(counters);
 }
 
-static void
-logerrors_load_params(void)
-{
-    DefineCustomIntVariable("logerrors.interval",
-                            "Time between writing stat to buffer (ms).",
-                            "Default of 5s, max of 60s",
-                            &interval,
-                            5000,
-                            1000,
-                            60000,
-                            PGC_SUSET,
-                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
-                            NULL,
-                            NULL,
-                            NULL);
-    DefineCustomIntVariable("logerrors.intervals_count",
-                            "Count of intervals in buffer",
-                            "Default of 120, max of 360",
-                            &intervals_count,
-                            120,
-                            2,
-                            max_intervals_count,
-                            PGC_SUSET,
-                            GUC_NO_RESET_ALL,
-                            NULL,
-                            NULL,
-                            NULL);
-    DefineCustomStringVariable("logerrors.excluded_errcodes",
-                               "Excluded error codes separated by ','",
-                               NULL,
-                               &excluded_errcodes_str,
-                               NULL,
-                               PGC_POSTMASTER,
-                               GUC_NO_RESET_ALL,
-                               NULL,
-                               NULL,
-                               NULL);
-    DefineCustomStringVariable("logerrors.stats_temp_directory",
-                               "Stats will be persisted in this directory",
-                               NULL,
-                               &stats_temp_directory,
-                               default_stats_temp_directory,
-                               PGC_POSTMASTER,
-                               GUC_NO_RESET_ALL,
-                               NULL,
-                               NULL,
-                               NULL);
-    DefineCustomIntVariable("logerrors.stats_flush_interval",
-                            "Stats persistence interval",
-                            "Default of 60s, max of 5min",
-                            &stats_persistence_interval,
-                            60*1000,
-                            5*1000,
-                            5*60*1000,
-                            PGC_SUSET,
-                            GUC_UNIT_MS | GUC_NO_RESET_ALL,
-                            NULL,
-                            NULL,
-                            NULL);
-}
 /*
- * Entry point for worker loading
+ * Emit counters of the interval just closed as one non-transactional logical
+ * decoding message, see logerrors_message.h. Empty intervals are skipped,
+ * standbys can't write WAL.
  */
-void
-_PG_init(void)
+static void
+publish_interval(void)
 {
-    BackgroundWorker worker;
-    if (!process_shared_preload_libraries_in_progress) {
+    StringInfoData buf;
+    LogerrorsMessageHeader header;
+    LogerrorsMessageRecord record;
+    HTAB *counters;
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+    int current_interval_index;
+    uint32 keys_count;
+    uint32 records_count;
+    struct timeval tv;
+
+    if (!publish_connected || RecoveryInProgress() || !logerrors_attach_dsa())
+        return;
+    get_buffer_state(&current_interval_index, &keys_count);
+    counters = count_up_errors(current_interval_index, 1, keys_count, project_stats_key);
+    records_count = hash_get_num_entries(counters);
+    if (records_count == 0) {
+        hash_destroy(counters);
         return;
     }
-    prev_shmem_startup_hook = shmem_startup_hook;
-    shmem_startup_hook = logerrors_shmem_startup;
-    prev_emit_log_hook = emit_log_hook;
-    emit_log_hook = logerrors_emit_log_hook;
-#if (PG_VERSION_NUM >= 150000)
-    prev_shmem_request_hook = shmem_request_hook;
-    shmem_request_hook = logerrors_shmem_request;
+    initStringInfo(&buf);
+    memset(&header, 0, sizeof(header));
+    gettimeofday(&tv, NULL);
+    header.version = pg_hton32(LOGERRORS_MESSAGE_VERSION);
+    header.records_count = pg_hton32(records_count);
+    header.interval_end = (int64) pg_hton64((uint64) tv.tv_sec * 1000000 + tv.tv_usec);
+    header.interval_ms = pg_hton32(global_variables->interval);
+    appendBinaryStringInfo(&buf, (char *) &header, sizeof(header));
+    hash_seq_init(&hash_seq, counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        memset(&record, 0, sizeof(record));
+        memcpy(record.sqlstate, unpack_sql_state(elem->key.error_code), sizeof(record.sqlstate));
+        record.type = elem->key.message_type_index;
+        record.db_oid = pg_hton32(elem->key.db_oid);
+        record.user_oid = pg_hton32(elem->key.user_oid);
+        record.count = pg_hton32(elem->counter);
+        appendBinaryStringInfo(&buf, (char *) &record, sizeof(record));
+    }
+#if (PG_VERSION_NUM >= 170000)
+    LogLogicalMessage(LOGERRORS_MESSAGE_PREFIX, buf.data, buf.len, false, true);
 #else
-    RequestAddinShmemSpace((sizeof(ErrorCode) + sizeof(ErrorName)) * error_codes_count + sizeof(GlobalInfo));
+    /* Nothing else makes idle server flush WAL soon */
+    XLogFlush(LogLogicalMessage(LOGERRORS_MESSAGE_PREFIX, buf.data, buf.len, false));
 #endif
-    /* Worker parameter and registration */
-    MemSet(&worker, 0, sizeof(BackgroundWorker));
-    worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
-    worker.bgw_start_time = BgWorkerStart_PostmasterStart;
-    snprintf(worker.bgw_name, BGW_MAXLEN, "%s", worker_name);
-    sprintf(worker.bgw_library_name, "logerrors");
-    sprintf(worker.bgw_function_name, "logerrors_main");
-    /* Wait 10 seconds for restart after crash */
-    worker.bgw_restart_time = 10;
-    worker.bgw_main_arg = (Datum) 0;
-    worker.bgw_notify_pid = 0;
-    RegisterBackgroundWorker(&worker);
-    logerrors_load_params();
+    pfree(buf.data);
+    hash_destroy(counters);
 }
 
-void
-_PG_fini(void)
+/* Slow statements by database */
+static bool
+project_slow_db_key(MessageInfo *key)
 {
-    emit_log_hook = prev_emit_log_hook;
-    shmem_startup_hook = prev_shmem_startup_hook;
+    MessageInfo projected;
+    if (key->message_type_index != slow_log_type_index)
+        return false;
+    memset(&projected, 0, sizeof(projected));
+    projected.db_oid = key->db_oid;
+    *key = projected;
+    return true;
 }
 
+/* Text of logerrors.prom, reused between writes */
+static StringInfoData prometheus_buf;
+static bool prometheus_buf_ready = false;
+
 static void
-logerrors_shmem_startup(void) {
-    bool found;
-    HASHCTL ctl;
-    if (prev_shmem_startup_hook)
-        prev_shmem_startup_hook();
-    error_names_hashtable = NULL;
-    global_variables = NULL;
-    memset(&ctl, 0, sizeof(ctl));
-    ctl.keysize = sizeof(ErrorCode);
-    ctl.entrysize = sizeof(ErrorName);
-    error_names_hashtable = ShmemInitHash("logerrors hash",
-                                          error_codes_count, error_codes_count,
-                                          &ctl,
-                                          HASH_ELEM | HASH_BLOBS);
-    global_variables = ShmemInitStruct("logerrors global_variables",
-                                       sizeof(GlobalInfo),
-                                       &found);
-    if (!IsUnderPostmaster) {
-        global_variables_init();
-        logerrors_init();
+append_prometheus_window(StringInfo buf, const char *window, int current_interval_index, int duration_in_intervals,
+                         uint32 keys_count, bool slow)
+{
+    HTAB *counters;
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+
+    counters = count_up_errors(current_interval_index, duration_in_intervals, keys_count,
+                               slow ? project_slow_db_key : project_stats_key);
+    hash_seq_init(&hash_seq, counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        if (slow)
+            appendStringInfo(buf, "logerrors_window_slow_statements{window=\"%s\",db_oid=\"%u\"} %u\n",
+                             window, elem->key.db_oid, elem->counter);
+        else
+            appendStringInfo(buf,
+                             "logerrors_window_messages{window=\"%s\",type=\"%s\",sqlstate=\"%s\",db_oid=\"%u\",user_oid=\"%u\"} %u\n",
+                             window, message_type_names[elem->key.message_type_index],
+                             unpack_sql_state(elem->key.error_code), elem->key.db_oid, elem->key.user_oid,
+                             elem->counter);
     }
-    return;
+    hash_destroy(counters);
 }
 
-#if (PG_VERSION_NUM >= 150000)
 /*
- * Requests any additional shared memory required for our extension
+ * Write counters for node_exporter textfile collector. Directory is handled
+ * like in write_to_stat_file(), file is written to temporary name which is
+ * ignored by collector and renamed, so collector never sees partial file.
  */
 static void
-logerrors_shmem_request(void)
+write_prometheus_file(void)
 {
-    if (prev_shmem_request_hook)
-        prev_shmem_request_hook();
+    char dir[MAXPGPATH];
+    char path[MAXPGPATH];
+    char tmp_path[MAXPGPATH];
+    char *expanded = prometheus_directory;
+    int current_interval_index;
+    uint32 keys_count;
+    int fd;
+    int i;
+    MemoryContext oldcontext;
+
+    if (prometheus_directory == NULL || prometheus_directory[0] == '\0' || !logerrors_attach_dsa())
+        return;
+    /* GUC value is kept as is, it is expanded on every write */
+    if (replace_pgdata_env(&expanded) == -1)
+        return;
+    strlcpy(dir, expanded, sizeof(dir));
+    remove_end_separator(dir);
+    if (create_dir_if_not_exist(dir, NULL, NULL) != 0)
+        return;
+    snprintf(path, sizeof(path), "%s/logerrors.prom", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/logerrors.prom.tmp", dir);
+
+    if (!prometheus_buf_ready) {
+        oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+        initStringInfo(&prometheus_buf);
+        MemoryContextSwitchTo(oldcontext);
+        prometheus_buf_ready = true;
+    }
+    resetStringInfo(&prometheus_buf);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    appendStringInfoString(&prometheus_buf,
+                           "# HELP logerrors_messages_total Messages since reset by type.\n"
+                           "# TYPE logerrors_messages_total counter\n");
+    for (i = 0; i < message_types_count; ++i)
+        appendStringInfo(&prometheus_buf, "logerrors_messages_total{type=\"%s\"} %u\n",
+                         message_type_names[i], pg_atomic_read_u32(&global_variables->total_count[i]));
+    appendStringInfoString(&prometheus_buf,
+                           "# HELP logerrors_window_messages Messages by type, sqlstate, database and user in last interval (short) and whole buffer (long).\n"
+                           "# TYPE logerrors_window_messages gauge\n");
+    append_prometheus_window(&prometheus_buf, "short", current_interval_index, 1, keys_count, false);
+    append_prometheus_window(&prometheus_buf, "long", current_interval_index, global_variables->intervals_count,
+                             keys_count, false);
+    appendStringInfo(&prometheus_buf,
+                     "# HELP logerrors_slow_statements_total Slow statements since reset.\n"
+                     "# TYPE logerrors_slow_statements_total counter\n"
+                     "logerrors_slow_statements_total %u\n",
+                     pg_atomic_read_u32(&global_variables->slow_log_info.count));
+    appendStringInfoString(&prometheus_buf,
+                           "# HELP logerrors_window_slow_statements Slow statements by database in last interval (short) and whole buffer (long).\n"
+                           "# TYPE logerrors_window_slow_statements gauge\n");
+    append_prometheus_window(&prometheus_buf, "short", current_interval_index, 1, keys_count, true);
+    append_prometheus_window(&prometheus_buf, "long", current_interval_index, global_variables->intervals_count,
+                             keys_count, true);
+    appendStringInfo(&prometheus_buf,
+                     "# HELP logerrors_dropped_total Messages not counted because key table is full.\n"
+                     "# TYPE logerrors_dropped_total counter\n"
+                     "logerrors_dropped_total " UINT64_FORMAT "\n",
+                     pg_atomic_read_u64(&global_variables->messagesBuffer.dropped_count));
 
-    RequestAddinShmemSpace((sizeof(ErrorCode) + sizeof(ErrorName)) * error_codes_count + sizeof(GlobalInfo));
+    fd = OpenTransientFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY);
+    if (fd < 0) {
+        elog(WARNING, "logerrors: could not create file \"%s\": %m", tmp_path);
+        return;
+    }
+    if (write(fd, prometheus_buf.data, prometheus_buf.len) != prometheus_buf.len) {
+        elog(WARNING, "logerrors: could not write file \"%s\": %m", tmp_path);
+        CloseTransientFile(fd);
+        unlink(tmp_path);
+        return;
+    }
+    if (CloseTransientFile(fd) != 0 || rename(tmp_path, path) != 0)
+        elog(WARNING, "logerrors: could not write file \"%s\": %m", path);
 }
-#endif
-
-PG_FUNCTION_INFO_V1(pg_log_errors_stats);
 
+/*
+ * Append counters of messages since previous write to errors-YYYY-MM-DD.csv
+ * near stats file: time,type,sqlstate,database,user,count. Bgworker may run
+ * without database connection, so database and user are oids here. Lines of
+ * logerrors_ingest have names from log files, logerrors_stat -m maps oids to
+ * them.
+ */
 static void
-count_up_errors(int duration_in_intervals, int current_interval, HTAB* counters_hashtable) {
-    bool found;
-    int i;
-    int j;
-    int interval_index;
-    int message_index;
-    MessageInfo key;
-    CounterHashElem* elem;
-    if (global_variables == NULL || counters_hashtable == NULL){
+write_errors_file(int duration_in_intervals)
+{
+    char path[256] = {0};
+    char buf[32] = {0};
+    char timebuf[64] = {0};
+    StringInfoData lines;
+    HTAB *counters;
+    HASH_SEQ_STATUS hash_seq;
+    CounterHashElem *elem;
+    int current_interval_index;
+    uint32 keys_count;
+    pg_time_t now;
+    int fd;
+
+    if (global_variables == NULL || duration_in_intervals <= 0 || !logerrors_attach_dsa())
         return;
-    }
-    /* put all messages to hashtable */
-    for (i = duration_in_intervals; i > 0; --i) {
-        interval_index = (current_interval - i + global_variables->actual_intervals_count)
-                         % global_variables->actual_intervals_count;
-        for (j = 0; j < messages_per_interval; ++j) {
-            message_index = interval_index * messages_per_interval + j;
-            if (global_variables->messagesBuffer.buffer[message_index].error_code == -1)
-                continue;
-            key.db_oid = global_variables->messagesBuffer.buffer[message_index].db_oid;
-            key.user_oid = global_variables->messagesBuffer.buffer[message_index].user_oid;
-            key.error_code = global_variables->messagesBuffer.buffer[message_index].error_code;
-            key.message_type_index = global_variables->messagesBuffer.buffer[message_index].message_type_index;
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_FIND, &found);
-            if (!found) {
-                elem = hash_search(counters_hashtable, (void *) &key, HASH_ENTER, &found);
-                elem->counter = 0;
-            }
-            elem->counter++;
+    if (!get_stats_directory(path))
+        return;
+    if (create_dir_if_not_exist(path, NULL, NULL) != 0)
+        return;
+    now = (pg_time_t) time(NULL);
+    pg_strftime(buf, sizeof(buf), "/errors-%Y-%m-%d.csv", pg_localtime(&now, log_timezone));
+    strcat(path, buf);
+    format_stats_time(timebuf);
+
+    get_buffer_state(&current_interval_index, &keys_count);
+    counters = count_up_errors(current_interval_index, duration_in_intervals, keys_count, project_stats_key);
+    initStringInfo(&lines);
+    hash_seq_init(&hash_seq, counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL)
+        appendStringInfo(&lines, "%s,%s,%s,%u,%u,%u\n", timebuf,
+                         message_type_names[elem->key.message_type_index],
+                         unpack_sql_state(elem->key.error_code), elem->key.db_oid, elem->key.user_oid,
+                         elem->counter);
+    hash_destroy(counters);
+    if (lines.len > 0) {
+        fd = create_file_if_not_exist(path);
+        if (fd >= 0) {
+            if (write(fd, lines.data, lines.len) != lines.len)
+                elog(WARNING, "logerrors: could not write file \"%s\": %m", path);
+            CloseTransientFile(fd);
         }
     }
+    pfree(lines.data);
 }
 
+PG_FUNCTION_INFO_V1(pg_log_errors_wait);
+
+/* Release slot of pg_log_errors_wait() on return, error or backend exit */
 static void
-put_values_to_tuple(
-        int current_interval_index,
-        int duration_in_intervals,
-        HTAB* counters_hashtable,
-        TupleDesc tupdesc,
-        Tuplestorestate *tupstore){
-#define logerrors_COLS	7
-    Datum long_interval_values[logerrors_COLS];
-    bool long_interval_nulls[logerrors_COLS];
-    bool found;
-    int message_index;
-    int interval_index;
+release_wait_slot(int code, Datum arg)
+{
+    int slot = DatumGetInt32(arg);
+
+    ConditionVariableCancelSleep();
+    pg_atomic_write_u32(&global_variables->wait_thresholds[slot], 0);
+    pg_atomic_fetch_sub_u32(&global_variables->waiters_count, 1);
+}
+
+/*
+ * Put keys of current interval reaching threshold to tuplestore. With class
+ * filter the whole class must reach threshold, then all its keys are shown.
+ */
+static bool
+put_waited_keys_to_tuple(uint32 threshold, int filter, bool filter_is_class, TupleDesc tupdesc,
+                         Tuplestorestate *tupstore)
+{
+#define WAIT_COLS	5
+    Datum values[WAIT_COLS];
+    bool nulls[WAIT_COLS];
+    int current_interval_index;
+    uint32 keys_count;
+    uint64 class_count = 0;
+    bool reached = false;
+    bool matches;
     int i;
-    int j;
-    int k;
-    char* db_name;
-    char* user_name;
-    char err_name_str[100];
-    ErrorName* err_name;
-    MessageInfo key;
-    ErrorCode err_code;
+    int counted_count;
+    char *db_name;
+    char *user_name;
+    CounterHashElem *counted;
     CounterHashElem *elem;
-    if (global_variables == NULL || counters_hashtable == NULL){
-        return;
-    }
-    count_up_errors(duration_in_intervals, current_interval_index, counters_hashtable);
-    for (i = duration_in_intervals; i > 0; --i) {
-        interval_index = (current_interval_index - i + global_variables->actual_intervals_count)
-                         % global_variables->actual_intervals_count;
-        for (j = 0; j < messages_per_interval; ++j) {
-            message_index = interval_index * messages_per_interval + j;
-            if (global_variables->messagesBuffer.buffer[message_index].error_code == -1)
-                continue;
-            key.db_oid = global_variables->messagesBuffer.buffer[message_index].db_oid;
-            key.user_oid = global_variables->messagesBuffer.buffer[message_index].user_oid;
-            key.error_code = global_variables->messagesBuffer.buffer[message_index].error_code;
-            key.message_type_index = global_variables->messagesBuffer.buffer[message_index].message_type_index;
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_FIND, &found);
-            if (!found) {
-                /* we already put this kind of message to output */
-                continue;
-            }
 
-            MemSet(long_interval_values, 0, sizeof(long_interval_values));
-            MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
-            for (k = 0; k < logerrors_COLS; ++k) {
-                long_interval_nulls[k] = false;
-            }
-            /* Time interval */
-            long_interval_values[0] = DatumGetInt32(global_variables->interval * duration_in_intervals / 1000);
-            /* Type */
-            long_interval_values[1] = CStringGetTextDatum(message_type_names[key.message_type_index]);
-            /* Message */
-            err_code.num = key.error_code;
-            err_name = hash_search(error_names_hashtable, (void *) &err_code, HASH_FIND, &found);
-            if (found)
-                long_interval_values[2] = CStringGetTextDatum(err_name->name);
-            else {
-                sprintf(err_name_str, "NOT_KNOWN_ERROR");
-                long_interval_values[2] = CStringGetTextDatum(err_name_str);
-            }
-            /* Count */
-            long_interval_values[3] = DatumGetInt32(elem->counter);
-            /* Username */
-            user_name = get_user_by_oid(key.user_oid);
-            if (user_name == NULL)
-                long_interval_nulls[4] = true;
-            else
-                long_interval_values[4] = CStringGetTextDatum(user_name);
-            /* Database name */
-            db_name = get_database_name(key.db_oid);
-            if (db_name == NULL)
-                long_interval_nulls[5] = true;
-            else
-                long_interval_values[5] = CStringGetTextDatum(db_name);
-
-            /* SQLState */
-            long_interval_values[6] = CStringGetTextDatum(unpack_sql_state(err_code.num));
-
-            if (elem->counter > 0) {
-                tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
-            }
-            /* Now remove key from hashtable */
-            elem = hash_search(counters_hashtable, (void *) &key, HASH_REMOVE, &found);
+    get_buffer_state(&current_interval_index, &keys_count);
+    /* Closed intervals end before current_interval_index, so shift by one to count current */
+    counted = order_counted_keys(count_up_errors(current_interval_index + 1, 1, keys_count, project_stats_key),
+                                 &counted_count);
+    if (filter_is_class) {
+        for (i = 0; i < counted_count; ++i) {
+            if (ERRCODE_TO_CATEGORY(counted[i].key.error_code) == filter)
+                class_count += counted[i].counter;
+        }
+        if (class_count < threshold) {
+            pfree(counted);
+            return false;
         }
     }
+    for (i = 0; i < counted_count; ++i) {
+        elem = &counted[i];
+        if (filter_is_class)
+            matches = ERRCODE_TO_CATEGORY(elem->key.error_code) == filter;
+        else
+            matches = (filter == 0 || elem->key.error_code == filter) && elem->counter >= threshold;
+        if (!matches)
+            continue;
+        reached = true;
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Type */
+        values[0] = CStringGetTextDatum(message_type_names[elem->key.message_type_index]);
+        /* SQLState */
+        values[1] = CStringGetTextDatum(unpack_sql_state(elem->key.error_code));
+        /* Username */
+        user_name = get_user_by_oid(elem->key.user_oid);
+        if (user_name == NULL)
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(user_name);
+        /* Database name */
+        db_name = get_database_name(elem->key.db_oid);
+        if (db_name == NULL)
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(db_name);
+        /* Count in current interval */
+        values[4] = Int32GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    pfree(counted);
+    return reached;
 }
 
-
+/*
+ * Wait until count of a key (type, sqlstate, user and database) in current
+ * interval reaches threshold, or timeout (ms) passes. Optional code limits
+ * keys to one code or, when it has two letters, to a class which total must
+ * reach threshold. Returns keys reaching threshold, nothing on timeout.
+ */
 Datum
-pg_log_errors_stats(PG_FUNCTION_ARGS)
+pg_log_errors_wait(PG_FUNCTION_ARGS)
 {
-#define logerrors_COLS	7
-    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
     TupleDesc	tupdesc;
     Tuplestorestate *tupstore;
-    MemoryContext per_query_ctx;
-    MemoryContext oldcontext;
-    HASHCTL ctl;
-    HTAB* counters_hashtable;
-    Datum long_interval_values[logerrors_COLS];
+    int threshold;
+    int timeout;
+    char *sqlstate;
+    int filter = 0;
+    bool filter_is_class = false;
+    int slot;
+    int i;
+    bool reached;
+    TimestampTz deadline;
+    long remaining;
 
-    bool long_interval_nulls[logerrors_COLS];
-    int current_interval_index;
-    int lvl_i;
-    int j;
-    /* Shmem structs not ready yet */
-    if (error_names_hashtable == NULL || global_variables == NULL) {
+    if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
         ereport(ERROR,
-                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-                        errmsg("logerrors must be loaded via shared_preload_libraries")));
-    }
-    /* check to see if caller supports us returning a tuplestore */
-    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+                (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+                        errmsg("threshold and timeout must not be null")));
+    threshold = PG_GETARG_INT32(0);
+    timeout = PG_GETARG_INT32(1);
+    sqlstate = PG_ARGISNULL(2) ? NULL : text_to_cstring(PG_GETARG_TEXT_PP(2));
+    if (threshold <= 0)
         ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("set-valued function called in context that cannot accept a set")));
-    if (!(rsinfo->allowedModes & SFRM_Materialize))
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("threshold must be positive")));
+    if (timeout < 0)
         ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("materialize mode required, but it is not allowed in this context")));
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                        errmsg("timeout must not be negative")));
+    if (sqlstate != NULL) {
+        if (strlen(sqlstate) != 2 && strlen(sqlstate) != len_sqlstate_str)
+            ereport(ERROR,
+                    (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                            errmsg("sqlstate should have 2 or %d characters", len_sqlstate_str)));
+        filter_is_class = strlen(sqlstate) == 2;
+        filter = MAKE_SQLSTATE(sqlstate[0], sqlstate[1],
+                               filter_is_class ? '0' : sqlstate[2],
+                               filter_is_class ? '0' : sqlstate[3],
+                               filter_is_class ? '0' : sqlstate[4]);
+    }
+#if (PG_VERSION_NUM < 130000)
+    ereport(ERROR,
+            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("pg_log_errors_wait() requires PostgreSQL 13 or later")));
+#endif
 
-    /* Build a tuple descriptor for our result type */
-    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    slot = -1;
+    for (i = 0; i < max_error_waiters && slot < 0; ++i) {
+        uint32 expected = 0;
+        if (pg_atomic_compare_exchange_u32(&global_variables->wait_thresholds[i], &expected, (uint32) threshold))
+            slot = i;
+    }
+    if (slot < 0)
         ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("return type must be a row type")));
-
-    counters_hashtable = NULL;
-    memset(&ctl, 0, sizeof(ctl));
-    ctl.keysize = sizeof(MessageInfo);
-    ctl.entrysize = sizeof(CounterHashElem);
-    /* an unshared hashtable can be expanded on-the-fly */
-    counters_hashtable = hash_create("counters hashtable", 1, &ctl, HASH_ELEM | HASH_BLOBS);
-
-    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-    oldcontext = MemoryContextSwitchTo(per_query_ctx);
-
-    tupstore = tuplestore_begin_heap(true, false, work_mem);
-    rsinfo->returnMode = SFRM_Materialize;
-    rsinfo->setResult = tupstore;
-    rsinfo->setDesc = tupdesc;
-    MemoryContextSwitchTo(oldcontext);
+                (errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+                        errmsg("too many backends wait in pg_log_errors_wait(), max is %d", max_error_waiters)));
+    pg_atomic_fetch_add_u32(&global_variables->waiters_count, 1);
 
-    LWLockAcquire(&global_variables->messagesBuffer.lock, LW_EXCLUSIVE);
-    current_interval_index = global_variables->messagesBuffer.current_interval_index;
-    LWLockRelease(&global_variables->messagesBuffer.lock);
-    /* 'TOTAL' counters */
-    for (lvl_i = 0; lvl_i < message_types_count; ++lvl_i) {
-
-        /* Add total count to result */
-        MemSet(long_interval_values, 0, sizeof(long_interval_values));
-        MemSet(long_interval_nulls, 0, sizeof(long_interval_nulls));
-        for (j = 0; j < logerrors_COLS; ++j) {
-            long_interval_nulls[j] = false;
+    deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout);
+    /* FATAL (pg_terminate_backend, postmaster death) skips PG_CATCH, so release slot on exit too */
+    PG_ENSURE_ERROR_CLEANUP(release_wait_slot, Int32GetDatum(slot));
+    {
+        ConditionVariablePrepareToSleep(&global_variables->wait_cv);
+        for (;;) {
+            reached = put_waited_keys_to_tuple((uint32) threshold, filter, filter_is_class, tupdesc, tupstore);
+            if (reached)
+                break;
+            remaining = (long) ((deadline - GetCurrentTimestamp()) / 1000);
+            if (remaining <= 0)
+                break;
+            /* Class totals and keys split by optional dimensions are not signaled, so check each interval too */
+#if (PG_VERSION_NUM >= 130000)
+            ConditionVariableTimedSleep(&global_variables->wait_cv, Min(remaining, global_variables->interval),
+                                        PG_WAIT_EXTENSION);
+#endif
         }
-        /* Time interval */
-        long_interval_nulls[0] = true;
-        /* Type */
-        long_interval_values[1] = CStringGetTextDatum(message_type_names[lvl_i]);
-        /* Message */
-        long_interval_values[2] = CStringGetTextDatum("TOTAL");
-        /* Count */
-        long_interval_values[3] = DatumGetInt32(pg_atomic_read_u32(&global_variables->total_count[lvl_i]));
-        /* Username */
-        long_interval_nulls[4] = true;
-        /* Database name */
-        long_interval_nulls[5] = true;
-        /* sqlstate */
-        long_interval_nulls[6] = true;
-        tuplestore_putvalues(tupstore, tupdesc, long_interval_values, long_interval_nulls);
     }
-    /* short interval counters */
-    put_values_to_tuple(current_interval_index, 1, counters_hashtable, tupdesc, tupstore);
-    /* long interval counters */
-    put_values_to_tuple(current_interval_index, global_variables->intervals_count, counters_hashtable, tupdesc,
-                        tupstore);
-    /* clean up */
-    hash_destroy(counters_hashtable);
-    /* return the tuplestore */
+    PG_END_ENSURE_ERROR_CLEANUP(release_wait_slot, Int32GetDatum(slot));
+    release_wait_slot(0, Int32GetDatum(slot));
+
     tuplestore_donestoring(tupstore);
     return (Datum) 0;
 }
 
-PG_FUNCTION_INFO_V1(pg_log_errors_reset);
+PG_FUNCTION_INFO_V1(pg_log_errors_ingest);
 
-Datum
-pg_log_errors_reset(PG_FUNCTION_ARGS) {
+typedef struct ingest_key {
+    int64 period_end;
+    char zone[16];
+    int type;
+    char sqlstate[8];
+    char database[NAMEDATALEN];
+    char user[NAMEDATALEN];
+} IngestKey;
 
-    if (error_names_hashtable == NULL || global_variables == NULL) {
-        ereport(ERROR,
-                (errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-                        errmsg("logerrors must be loaded via shared_preload_libraries")));
-    }
+typedef struct ingest_hashelem {
+    IngestKey key;
+    int64 counter;
+} IngestHashElem;
 
-    logerrors_init();
+typedef struct ingest_state {
+    HTAB *counters;
+    int period;
+} IngestState;
 
-    PG_RETURN_VOID();
+static void
+copy_log_field(char *buf, size_t size, const LogparseField *field)
+{
+    size_t len = Min(field->len, size - 1);
+    memcpy(buf, field->data, len);
+    buf[len] = '\0';
 }
 
-PG_FUNCTION_INFO_V1(pg_slow_log_stats);
+static void
+ingest_record(const LogparseRecord *record, void *arg)
+{
+    IngestState *state = (IngestState *) arg;
+    IngestKey key;
+    IngestHashElem *elem;
+    LogparseField zone;
+    int64_t seconds;
+    int type;
+    bool found;
+
+    type = logparse_record_type(record);
+    if (type < 0 || logparse_time(&record->time, &seconds, &zone) != 0)
+        return;
+    memset(&key, 0, sizeof(key));
+    /* Period is identified by its end, like lines of stats files */
+    key.period_end = (seconds >= 0 ? seconds / state->period : (seconds - state->period + 1) / state->period)
+                     * state->period + state->period;
+    copy_log_field(key.zone, sizeof(key.zone), &zone);
+    key.type = type;
+    if (type != LOGPARSE_SLOW)
+        copy_log_field(key.sqlstate, sizeof(key.sqlstate), &record->sqlstate);
+    logparse_copy_unescaped(record, &record->database, key.database, sizeof(key.database));
+    logparse_copy_unescaped(record, &record->user, key.user, sizeof(key.user));
+    elem = hash_search(state->counters, (void *) &key, HASH_ENTER, &found);
+    if (!found)
+        elem->counter = 0;
+    elem->counter++;
+}
 
+/*
+ * Count messages of csvlog or jsonlog file by period, type, sqlstate,
+ * database and user. File is mapped and scanned without copying, so old logs
+ * can be analysed without loading them into a table.
+ */
 Datum
-pg_slow_log_stats(PG_FUNCTION_ARGS)
+pg_log_errors_ingest(PG_FUNCTION_ARGS)
 {
-#define SLOW_LOG_COLS 2
-    ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
-    Tuplestorestate *tupstore;
+#define INGEST_COLS	6
+    static const char *type_names[LOGPARSE_TYPES_COUNT] = {"WARNING", "ERROR", "FATAL", "SLOW"};
     TupleDesc tupdesc;
-    MemoryContext per_query_ctx;
-    MemoryContext oldcontext;
-    int i;
+    Tuplestorestate *tupstore;
+    Datum values[INGEST_COLS];
+    bool nulls[INGEST_COLS];
+    char *path;
+    LogparseFormat format;
+    IngestState state;
+    HASHCTL ctl;
+    HASH_SEQ_STATUS hash_seq;
+    IngestHashElem *elem;
+    LogparseField zone;
+    char timebuf[64];
+    struct stat st;
+    char *map;
+    int fd;
 
-    Datum result_values[SLOW_LOG_COLS];
-    bool result_nulls[SLOW_LOG_COLS];
+    if (PG_ARGISNULL(0))
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("path must not be null")));
+    path = text_to_cstring(PG_GETARG_TEXT_PP(0));
+    state.period = PG_ARGISNULL(1) ? 60 : PG_GETARG_INT32(1);
+    if (state.period <= 0)
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("interval_seconds must be positive")));
+    if (PG_ARGISNULL(2))
+        format = logparse_guess_format(path);
+    else if (strcmp(text_to_cstring(PG_GETARG_TEXT_PP(2)), "json") == 0)
+        format = LOGPARSE_JSON;
+    else if (strcmp(text_to_cstring(PG_GETARG_TEXT_PP(2)), "csv") == 0)
+        format = LOGPARSE_CSV;
+    else
+        ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("format must be \"csv\" or \"json\"")));
 
-    /* Shmem structs not ready yet */
-    if (global_variables == NULL) {
-        return (Datum) 0;
+    /* Same privileges as pg_read_file() of arbitrary path */
+#if (PG_VERSION_NUM >= 140000)
+    if (!has_privs_of_role(GetUserId(), ROLE_PG_READ_SERVER_FILES))
+#else
+    if (!is_member_of_role(GetUserId(), DEFAULT_ROLE_READ_SERVER_FILES))
+#endif
+        ereport(ERROR, (errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+                        errmsg("must be superuser or a member of pg_read_server_files to ingest log files")));
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    memset(&ctl, 0, sizeof(ctl));
+    ctl.keysize = sizeof(IngestKey);
+    ctl.entrysize = sizeof(IngestHashElem);
+    state.counters = hash_create("ingest counters hashtable", 64, &ctl, HASH_ELEM | HASH_BLOBS);
+
+    fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+    if (fd < 0)
+        ereport(ERROR, (errcode_for_file_access(), errmsg("could not open file \"%s\": %m", path)));
+    if (fstat(fd, &st) != 0)
+        ereport(ERROR, (errcode_for_file_access(), errmsg("could not stat file \"%s\": %m", path)));
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+            ereport(ERROR, (errcode_for_file_access(), errmsg("could not map file \"%s\": %m", path)));
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        PG_TRY();
+        {
+            logparse_buffer(format, map, st.st_size, ingest_record, &state);
+        }
+        PG_CATCH();
+        {
+            munmap(map, st.st_size);
+            PG_RE_THROW();
+        }
+        PG_END_TRY();
+        munmap(map, st.st_size);
     }
-    /* check to see if caller supports us returning a tuplestore */
-    if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("set-valued function called in context that cannot accept a set")));
-    if (!(rsinfo->allowedModes & SFRM_Materialize))
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("materialize mode required, but it is not allowed in this context")));
+    CloseTransientFile(fd);
 
-    /* Build a tuple descriptor for our result type */
-    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-        ereport(ERROR,
-                (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                        errmsg("return type must be a row type")));
+    hash_seq_init(&hash_seq, state.counters);
+    while ((elem = hash_seq_search(&hash_seq)) != NULL) {
+        MemSet(values, 0, sizeof(values));
+        MemSet(nulls, 0, sizeof(nulls));
+        /* Time, end of period in zone of log */
+        zone.data = elem->key.zone;
+        zone.len = strlen(elem->key.zone);
+        logparse_format_time(elem->key.period_end, &zone, timebuf, sizeof(timebuf));
+        values[0] = DirectFunctionCall3(timestamptz_in, CStringGetDatum(timebuf),
+                                        ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1));
+        /* Type */
+        values[1] = CStringGetTextDatum(type_names[elem->key.type]);
+        /* SQLState, slow statements have none */
+        if (elem->key.sqlstate[0] == '\0')
+            nulls[2] = true;
+        else
+            values[2] = CStringGetTextDatum(elem->key.sqlstate);
+        /* Username */
+        if (elem->key.user[0] == '\0')
+            nulls[3] = true;
+        else
+            values[3] = CStringGetTextDatum(elem->key.user);
+        /* Database name */
+        if (elem->key.database[0] == '\0')
+            nulls[4] = true;
+        else
+            values[4] = CStringGetTextDatum(elem->key.database);
+        /* Count */
+        values[5] = Int64GetDatum(elem->counter);
+        tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    }
+    hash_destroy(state.counters);
+    tuplestore_donestoring(tupstore);
+    return (Datum) 0;
+}
 
-    per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
-    oldcontext = MemoryContextSwitchTo(per_query_ctx);
+PG_FUNCTION_INFO_V1(pg_log_errors_accuracy);
 
-    tupstore = tuplestore_begin_heap(true, false, work_mem);
-    rsinfo->returnMode = SFRM_Materialize;
-    rsinfo->setResult = tupstore;
-    rsinfo->setDesc = tupdesc;
-    MemoryContextSwitchTo(oldcontext);
+static void
+put_accuracy_to_tuple(int current_interval_index, int duration_in_intervals, TupleDesc tupdesc,
+                      Tuplestorestate *tupstore)
+{
+#define ACCURACY_COLS	3
+    Datum values[ACCURACY_COLS];
+    bool nulls[ACCURACY_COLS];
+    uint64 sampled = 0;
+    uint64 variance = 0;
+    int interval_index;
+    int i;
 
-    MemSet(result_values, 0, sizeof(result_values));
-    MemSet(result_nulls, 0, sizeof(result_nulls));
-    for (i = 0; i < SLOW_LOG_COLS; i++) {
-        result_nulls[i] = false;
+    for (i = duration_in_intervals; i > 0; --i) {
+        interval_index = (current_interval_index - i + global_variables->actual_intervals_count)
+                         % global_variables->actual_intervals_count;
+        sampled += pg_atomic_read_u64(&global_variables->sampled_counts[interval_index]);
+        variance += pg_atomic_read_u64(&global_variables->sampled_variance[interval_index]);
     }
-    result_values[0] = DatumGetInt32(pg_atomic_read_u32(&global_variables->slow_log_info.count));
-    result_values[1] = DatumGetTimestamp(pg_atomic_read_u64(&global_variables->slow_log_info.reset_time));
+    MemSet(values, 0, sizeof(values));
+    MemSet(nulls, 0, sizeof(nulls));
+    /* Time interval */
+    values[0] = Int32GetDatum(global_variables->interval * duration_in_intervals / 1000);
+    /* Estimated messages counted by sampling */
+    values[1] = Int64GetDatum((int64) sampled);
+    /* Standard deviation of their estimate, it bounds deviation of any count of the window */
+    values[2] = Float8GetDatum(sqrt((double) variance));
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
 
-    tuplestore_putvalues(tupstore, tupdesc, result_values, result_nulls);
-    /* return the tuplestore */
+/*
+ * Accuracy of counts when logerrors.sampling_threshold is set. Without
+ * arguments shows short and long windows, otherwise last window_seconds.
+ */
+Datum
+pg_log_errors_accuracy(PG_FUNCTION_ARGS)
+{
+    TupleDesc	tupdesc;
+    Tuplestorestate *tupstore;
+    int current_interval_index;
+    uint32 keys_count;
+    int window_intervals;
+
+    tupstore = init_result_tuplestore(fcinfo, &tupdesc);
+    get_buffer_state(&current_interval_index, &keys_count);
+
+    if (PG_NARGS() > 0 && !PG_ARGISNULL(0)) {
+        window_intervals = window_to_intervals(PG_GETARG_INT32(0));
+        put_accuracy_to_tuple(current_interval_index, window_intervals, tupdesc, tupstore);
+    } else {
+        /* short interval */
+        put_accuracy_to_tuple(current_interval_index, 1, tupdesc, tupstore);
+        /* long interval */
+        put_accuracy_to_tuple(current_interval_index, global_variables->intervals_count, tupdesc, tupstore);
+    }
     tuplestore_donestoring(tupstore);
     return (Datum) 0;
 }
@@ -0,0 +1,69 @@
+/*
+ * Layout of the file exported by logerrors bgworker (logerrors.export_file).
+ *
+ * The file has fixed size: header followed by max_records records. The
+ * bgworker maps it once and rewrites it in place after each interval, so
+ * local collectors can map it read-only and read counters without database
+ * connection. All fields are in host byte order.
+ *
+ * Consistency is protected by seqlock. Writer makes sequence odd, writes
+ * header and records, then makes sequence even again. Reader:
+ *   1. loads sequence (acquire), retries if it is odd;
+ *   2. copies header and records_count records;
+ *   3. loads sequence again after acquire fence, retries if it changed.
+ * Magic, version, header_size and record_size must be checked on the copy.
+ * New fields are only appended to structures with version bump.
+ *
+ * This header is shared with tools, it must not depend on postgres headers.
+ */
+#ifndef LOGERRORS_EXPORT_H
+#define LOGERRORS_EXPORT_H
+
+#include <stdint.h>
+
+/* "LEXP" */
+#define LOGERRORS_EXPORT_MAGIC	0x5058454C
+#define LOGERRORS_EXPORT_VERSION	1
+#define LOGERRORS_EXPORT_MAX_RECORDS	4096
+
+typedef struct logerrors_export_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    /* Odd while bgworker writes the file */
+    uint64_t sequence;
+    /* Time of last update, microseconds since Unix epoch */
+    int64_t updated_at;
+    uint32_t interval_ms;
+    uint32_t intervals_count;
+    uint32_t max_records;
+    uint32_t records_count;
+    /* WARNING, ERROR, FATAL messages and slow statements since reset */
+    uint64_t total_warning;
+    uint64_t total_error;
+    uint64_t total_fatal;
+    uint64_t total_slow;
+    /* Messages not counted because key table is full */
+    uint64_t dropped;
+    /* Records not exported because file is full */
+    uint64_t truncated;
+} LogerrorsExportHeader;
+
+/* Counters of type, sqlstate, database and user, like pg_log_errors_stats() */
+typedef struct logerrors_export_record {
+    /* NUL-terminated */
+    char sqlstate[8];
+    char type[8];
+    uint32_t db_oid;
+    uint32_t user_oid;
+    /* Last closed interval */
+    uint32_t short_count;
+    /* All intervals of buffer */
+    uint32_t long_count;
+} LogerrorsExportRecord;
+
+#define LOGERRORS_EXPORT_FILE_SIZE \
+    (sizeof(LogerrorsExportHeader) + sizeof(LogerrorsExportRecord) * LOGERRORS_EXPORT_MAX_RECORDS)
+
+#endif /* LOGERRORS_EXPORT_H */
@@ -0,0 +1,43 @@
+/*
+ * Payload of logical decoding messages emitted by logerrors bgworker
+ * (logerrors.publish_database).
+ *
+ * After each interval with messages the bgworker writes one non-transactional
+ * message with prefix LOGERRORS_MESSAGE_PREFIX: header followed by
+ * records_count records. Consumers get it through any output plugin
+ * supporting messages, e.g. pgoutput with messages option or test_decoding.
+ * All fields are in network byte order, structures have no padding.
+ * New fields are only appended to structures with version bump.
+ *
+ * This header is shared with consumers, it must not depend on postgres headers.
+ */
+#ifndef LOGERRORS_MESSAGE_H
+#define LOGERRORS_MESSAGE_H
+
+#include <stdint.h>
+
+#define LOGERRORS_MESSAGE_PREFIX	"logerrors"
+#define LOGERRORS_MESSAGE_VERSION	1
+
+typedef struct logerrors_message_header {
+    uint32_t version;
+    uint32_t records_count;
+    /* End of interval, microseconds since Unix epoch */
+    int64_t interval_end;
+    uint32_t interval_ms;
+    uint32_t reserved;
+} LogerrorsMessageHeader;
+
+/* Count of type, sqlstate, database and user in the interval */
+typedef struct logerrors_message_record {
+    /* Not NUL-terminated */
+    char sqlstate[5];
+    /* 0 WARNING, 1 ERROR, 2 FATAL */
+    uint8_t type;
+    uint8_t reserved[2];
+    uint32_t db_oid;
+    uint32_t user_oid;
+    uint32_t count;
+} LogerrorsMessageRecord;
+
+#endif /* LOGERRORS_MESSAGE_H */
@@ -0,0 +1,389 @@
+/*
+ * Streaming parser of PostgreSQL csvlog and jsonlog files, see logparse.h.
+ *
+ * Scanning relies on memchr(), which is vectorized by C libraries, to skip
+ * long quoted messages and lines instead of looking at each byte.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "logparse.h"
+
+/* Columns of csvlog */
+#define CSV_TIME	0
+#define CSV_USER	1
+#define CSV_DATABASE	2
+#define CSV_SEVERITY	11
+#define CSV_SQLSTATE	12
+#define CSV_MESSAGE	13
+
+LogparseFormat
+logparse_guess_format(const char *path)
+{
+    size_t len = strlen(path);
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+        return LOGPARSE_JSON;
+    return LOGPARSE_CSV;
+}
+
+/* Read one CSV field starting at p, returns position of delimiter after it */
+static const char *
+csv_field(const char *p, const char *end, LogparseField *field)
+{
+    const char *q;
+
+    if (p < end && *p == '"') {
+        q = p + 1;
+        for (;;) {
+            q = memchr(q, '"', end - q);
+            if (q == NULL) {
+                field->data = p + 1;
+                field->len = end - p - 1;
+                return end;
+            }
+            /* Doubled quote is a quote inside of field */
+            if (q + 1 < end && q[1] == '"') {
+                q += 2;
+                continue;
+            }
+            break;
+        }
+        field->data = p + 1;
+        field->len = q - p - 1;
+        q++;
+    } else {
+        q = p;
+        while (q < end && *q != ',' && *q != '\n')
+            q++;
+        field->data = p;
+        field->len = q - p;
+    }
+    /* Skip garbage up to delimiter */
+    while (q < end && *q != ',' && *q != '\n')
+        q++;
+    return q;
+}
+
+static size_t
+parse_csv(const char *data, size_t len, logparse_callback callback, void *arg)
+{
+    const char *p = data;
+    const char *end = data + len;
+    LogparseRecord record;
+    LogparseField field;
+    size_t count = 0;
+    int column;
+
+    while (p < end) {
+        memset(&record, 0, sizeof(record));
+        record.format = LOGPARSE_CSV;
+        column = 0;
+        for (;;) {
+            p = csv_field(p, end, &field);
+            switch (column) {
+                case CSV_TIME:
+                    record.time = field;
+                    break;
+                case CSV_USER:
+                    record.user = field;
+                    break;
+                case CSV_DATABASE:
+                    record.database = field;
+                    break;
+                case CSV_SEVERITY:
+                    record.severity = field;
+                    break;
+                case CSV_SQLSTATE:
+                    record.sqlstate = field;
+                    break;
+                case CSV_MESSAGE:
+                    record.message = field;
+                    break;
+            }
+            column++;
+            if (p >= end)
+                break;
+            if (*p++ == '\n')
+                break;
+        }
+        if (column > CSV_MESSAGE) {
+            callback(&record, arg);
+            count++;
+        }
+    }
+    return count;
+}
+
+/* Find needle in haystack, memchr() finds candidates */
+static const char *
+find_bytes(const char *haystack, const char *end, const char *needle, size_t needle_len)
+{
+    const char *p = haystack;
+    while (p + needle_len <= end) {
+        p = memchr(p, needle[0], end - p - needle_len + 1);
+        if (p == NULL)
+            return NULL;
+        if (memcmp(p, needle, needle_len) == 0)
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+/* Value of string key of one-line JSON object, escapes are kept */
+static void
+json_string(const char *line, const char *end, const char *key, LogparseField *field)
+{
+    char pattern[32];
+    size_t pattern_len;
+    const char *p;
+    const char *q;
+    const char *b;
+
+    pattern_len = snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    p = find_bytes(line, end, pattern, pattern_len);
+    if (p == NULL)
+        return;
+    p += pattern_len;
+    q = p;
+    for (;;) {
+        q = memchr(q, '"', end - q);
+        if (q == NULL)
+            return;
+        /* Quote is escaped if odd count of backslashes precedes it */
+        for (b = q; b > p && b[-1] == '\\'; --b)
+            ;
+        if ((q - b) % 2 == 0)
+            break;
+        q++;
+    }
+    field->data = p;
+    field->len = q - p;
+}
+
+static size_t
+parse_json(const char *data, size_t len, logparse_callback callback, void *arg)
+{
+    const char *p = data;
+    const char *end = data + len;
+    const char *line_end;
+    LogparseRecord record;
+    size_t count = 0;
+
+    while (p < end) {
+        line_end = memchr(p, '\n', end - p);
+        if (line_end == NULL)
+            line_end = end;
+        if (line_end > p && *p == '{') {
+            memset(&record, 0, sizeof(record));
+            record.format = LOGPARSE_JSON;
+            json_string(p, line_end, "timestamp", &record.time);
+            json_string(p, line_end, "user", &record.user);
+            json_string(p, line_end, "dbname", &record.database);
+            json_string(p, line_end, "error_severity", &record.severity);
+            json_string(p, line_end, "state_code", &record.sqlstate);
+            json_string(p, line_end, "message", &record.message);
+            callback(&record, arg);
+            count++;
+        }
+        p = line_end + 1;
+    }
+    return count;
+}
+
+size_t
+logparse_buffer(LogparseFormat format, const char *data, size_t len, logparse_callback callback, void *arg)
+{
+    if (format == LOGPARSE_JSON)
+        return parse_json(data, len, callback, arg);
+    return parse_csv(data, len, callback, arg);
+}
+
+/* Value of four hex digits, -1 if they are not */
+static int
+parse_hex4(const char *p)
+{
+    int value = 0;
+    int i;
+    for (i = 0; i < 4; ++i) {
+        value <<= 4;
+        if (p[i] >= '0' && p[i] <= '9')
+            value |= p[i] - '0';
+        else if (p[i] >= 'a' && p[i] <= 'f')
+            value |= p[i] - 'a' + 10;
+        else if (p[i] >= 'A' && p[i] <= 'F')
+            value |= p[i] - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+void
+logparse_copy_unescaped(const LogparseRecord *record, const LogparseField *field, char *buf, size_t size)
+{
+    const char *p = field->data;
+    const char *end = field->data + field->len;
+    size_t len = 0;
+    char c;
+    int code;
+
+    while (p < end && len < size - 1) {
+        c = *p++;
+        if (record->format == LOGPARSE_CSV) {
+            /* Quote inside quoted field is doubled */
+            if (c == '"' && p < end && *p == '"')
+                p++;
+        } else if (c == '\\' && p < end) {
+            c = *p++;
+            switch (c) {
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'u':
+                    /* Code points of names are encoded back to UTF-8, surrogates are not expected there */
+                    code = end - p >= 4 ? parse_hex4(p) : -1;
+                    if (code < 0)
+                        break;
+                    p += 4;
+                    if (code < 0x80) {
+                        c = (char) code;
+                        break;
+                    }
+                    if (code < 0x800) {
+                        if (len + 2 > size - 1)
+                            goto done;
+                        buf[len++] = (char) (0xC0 | (code >> 6));
+                    } else {
+                        if (len + 3 > size - 1)
+                            goto done;
+                        buf[len++] = (char) (0xE0 | (code >> 12));
+                        buf[len++] = (char) (0x80 | ((code >> 6) & 0x3F));
+                    }
+                    c = (char) (0x80 | (code & 0x3F));
+                    break;
+            }
+        }
+        buf[len++] = c;
+    }
+done:
+    buf[len] = '\0';
+}
+
+static int
+field_equals(const LogparseField *field, const char *str)
+{
+    size_t len = strlen(str);
+    return field->len == len && memcmp(field->data, str, len) == 0;
+}
+
+int
+logparse_record_type(const LogparseRecord *record)
+{
+    if (field_equals(&record->severity, "ERROR"))
+        return LOGPARSE_ERROR;
+    if (field_equals(&record->severity, "WARNING"))
+        return LOGPARSE_WARNING;
+    if (field_equals(&record->severity, "FATAL"))
+        return LOGPARSE_FATAL;
+    /* Same check as in emit_log_hook */
+    if (field_equals(&record->severity, "LOG") &&
+        find_bytes(record->message.data, record->message.data + record->message.len, "duration:", 9) != NULL)
+        return LOGPARSE_SLOW;
+    return -1;
+}
+
+/* Days since 1970-01-01 of civil date */
+static int64_t
+days_from_civil(int64_t y, int m, int d)
+{
+    int64_t era;
+    int64_t yoe;
+    int64_t doy;
+    int64_t doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static int
+parse_number(const char *p, int digits)
+{
+    int value = 0;
+    int i;
+    for (i = 0; i < digits; ++i) {
+        if (p[i] < '0' || p[i] > '9')
+            return -1;
+        value = value * 10 + (p[i] - '0');
+    }
+    return value;
+}
+
+int
+logparse_time(const LogparseField *time, int64_t *seconds, LogparseField *zone)
+{
+    const char *p = time->data;
+    const char *end = time->data + time->len;
+    int year, month, day, hour, minute, second;
+
+    /* YYYY-MM-DD HH:MM:SS */
+    if (time->len < 19 || p[4] != '-' || p[7] != '-' || p[10] != ' ' || p[13] != ':' || p[16] != ':')
+        return -1;
+    year = parse_number(p, 4);
+    month = parse_number(p + 5, 2);
+    day = parse_number(p + 8, 2);
+    hour = parse_number(p + 11, 2);
+    minute = parse_number(p + 14, 2);
+    second = parse_number(p + 17, 2);
+    if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || minute < 0 || second < 0)
+        return -1;
+    *seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    p += 19;
+    /* Fraction of second */
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+    }
+    while (p < end && *p == ' ')
+        p++;
+    zone->data = p;
+    zone->len = end - p;
+    return 0;
+}
+
+void
+logparse_format_time(int64_t seconds, const LogparseField *zone, char *buf, size_t size)
+{
+    int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+    int64_t rem = seconds - days * 86400;
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = (int) (doy - (153 * mp + 2) / 5 + 1);
+    int month = (int) (mp < 10 ? mp + 3 : mp - 9);
+    int64_t year = yoe + era * 400 + (month <= 2);
+
+    snprintf(buf, size, "%04d-%02d-%02d %02d:%02d:%02d.000000%s%.*s",
+             (int) year, month, day, (int) (rem / 3600), (int) (rem % 3600 / 60), (int) (rem % 60),
+             zone->len > 0 ? " " : "", (int) zone->len, zone->data);
+}
@@ -0,0 +1,68 @@
+/*
+ * Streaming parser of PostgreSQL csvlog and jsonlog files.
+ *
+ * Shared by pg_log_errors_ingest() and tools/logerrors_ingest, so it must
+ * not depend on postgres headers. Parser works on a whole buffer (usually
+ * mapped file) and doesn't copy anything: fields point into the buffer.
+ */
+#ifndef LOGPARSE_H
+#define LOGPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum logparse_format {
+    LOGPARSE_CSV,
+    LOGPARSE_JSON
+} LogparseFormat;
+
+/* Field of record, quoted CSV fields keep doubled quotes and JSON strings keep escapes */
+typedef struct logparse_field {
+    const char *data;
+    size_t len;
+} LogparseField;
+
+typedef struct logparse_record {
+    LogparseFormat format;
+    LogparseField time;
+    LogparseField user;
+    LogparseField database;
+    LogparseField severity;
+    LogparseField sqlstate;
+    LogparseField message;
+} LogparseRecord;
+
+/* Types of records counted by logerrors, same order as in stats files */
+#define LOGPARSE_WARNING	0
+#define LOGPARSE_ERROR	1
+#define LOGPARSE_FATAL	2
+#define LOGPARSE_SLOW	3
+#define LOGPARSE_TYPES_COUNT	4
+
+typedef void (*logparse_callback)(const LogparseRecord *record, void *arg);
+
+/* Format by file name: ".json" is jsonlog, anything else is csvlog */
+extern LogparseFormat logparse_guess_format(const char *path);
+
+/* Call callback for each record of buffer, returns count of records */
+extern size_t logparse_buffer(LogparseFormat format, const char *data, size_t len,
+                              logparse_callback callback, void *arg);
+
+/* Copy field of record to buf without CSV doubled quotes or JSON escapes, truncated to size */
+extern void logparse_copy_unescaped(const LogparseRecord *record, const LogparseField *field,
+                                    char *buf, size_t size);
+
+/* One of LOGPARSE_* types or -1 if record is not counted */
+extern int logparse_record_type(const LogparseRecord *record);
+
+/*
+ * Parse "YYYY-MM-DD HH:MM:SS[.fff] ZONE" to seconds since epoch of that
+ * wall clock (zone offset is not applied) and zone abbreviation.
+ * Returns 0 on success.
+ */
+extern int logparse_time(const LogparseField *time, int64_t *seconds, LogparseField *zone);
+
+/* Format seconds and zone back like stats files do: "YYYY-MM-DD HH:MM:SS.000000 ZONE" */
+extern void logparse_format_time(int64_t seconds, const LogparseField *zone, char *buf, size_t size);
+
+#endif /* LOGPARSE_H */
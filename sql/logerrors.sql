@@ -1,7 +1,7 @@
 SET ROLE postgres;
 SELECT pg_log_errors_reset();
 SELECT blah();
-SELECT pg_sleep(10);
+SELECT pg_sleep(2);
 SELECT * FROM pg_log_errors_stats();
 DO LANGUAGE plpgsql $$
 BEGIN
@@ -13,5 +13,338 @@ BEGIN
     RAISE SQLSTATE 'XXXXY';
 END;
 $$;
-SELECT pg_sleep(5);
+SELECT pg_sleep(1);
 SELECT * FROM pg_log_errors_stats();
+-- Functions below are granted to pg_monitor, not to PUBLIC
+RESET ROLE;
+GRANT pg_monitor TO postgres;
+CREATE ROLE logerrors_nobody;
+SET ROLE logerrors_nobody;
+SELECT * FROM pg_log_errors_capacity();
+SET ROLE postgres;
+-- Key table capacity
+SELECT keys > 0 AS has_keys, keys <= max_keys AS fits, dropped, reclaimed, warning FROM pg_log_errors_capacity();
+-- Integrity errors by relation and constraint
+RESET ROLE;
+CREATE TABLE logerrors_items (id integer PRIMARY KEY, qty integer CHECK (qty > 0));
+GRANT ALL ON logerrors_items TO postgres;
+SET logerrors.track_relations = on;
+SET ROLE postgres;
+INSERT INTO logerrors_items VALUES (1, 1);
+INSERT INTO logerrors_items VALUES (1, 1);
+INSERT INTO logerrors_items VALUES (2, 0);
+RESET ROLE;
+RESET logerrors.track_relations;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT relation, constraint_name, sqlstate, count FROM pg_log_errors_relations() WHERE time_interval = 360 ORDER BY sqlstate;
+-- Errors by source location
+RESET ROLE;
+SET logerrors.track_locations = on;
+SET ROLE postgres;
+SELECT 1/0;
+RESET ROLE;
+RESET logerrors.track_locations;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT type, funcname, sqlstate, count FROM pg_log_errors_locations() WHERE time_interval = 360;
+-- Lock and serialization failures, prepared transaction holds the row
+RESET ROLE;
+BEGIN;
+UPDATE logerrors_items SET qty = 2 WHERE id = 1;
+PREPARE TRANSACTION 'logerrors_lock';
+SET ROLE postgres;
+SET lock_timeout = '100ms';
+UPDATE logerrors_items SET qty = 3 WHERE id = 1;
+RESET lock_timeout;
+RESET ROLE;
+COMMIT PREPARED 'logerrors_lock';
+SET ROLE postgres;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE SQLSTATE '40001' USING TABLE = 'logerrors_items', SCHEMA = 'public';
+END;
+$$;
+SELECT pg_sleep(1.5);
+SELECT sqlstate, relation, username, database, count FROM pg_log_errors_contention() WHERE time_interval = 360 ORDER BY sqlstate;
+-- Urgent message is handled before the end of interval
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE SQLSTATE '53200';
+END;
+$$;
+SELECT pg_sleep(0.2);
+RESET ROLE;
+SELECT (string_to_array(rtrim(pg_read_file('logerrors.urgent'), E'\n'), ','))[2:4] AS urgent;
+SET ROLE postgres;
+-- Authentication failures by client address, other backends report them as FATAL
+SET ROLE logerrors_nobody;
+SELECT * FROM pg_log_errors_clients();
+SET ROLE postgres;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE SQLSTATE '28P01';
+END;
+$$;
+SELECT pg_sleep(1.5);
+SELECT client_addr, sqlstate, count FROM pg_log_errors_clients(360);
+SELECT * FROM pg_log_errors_clients(0);
+-- Backend repeating the same failing statement
+SET ROLE logerrors_nobody;
+SELECT * FROM pg_log_errors_suspects();
+RESET ROLE;
+SET logerrors.retry_loop_threshold = 3;
+SET ROLE postgres;
+SELECT 2/0;
+SELECT 2/0;
+SELECT 2/0;
+RESET ROLE;
+RESET logerrors.retry_loop_threshold;
+SET ROLE postgres;
+SELECT pid = pg_backend_pid() AS same_backend, username, database, sqlstate, run_length FROM pg_log_errors_suspects();
+-- Errors and transactions by database
+SELECT time_interval, database FROM pg_log_errors_db_ratio() WHERE database = current_database() ORDER BY time_interval;
+SELECT database, errors > 0 AS has_errors FROM pg_log_errors_db_ratio(360) WHERE database = current_database();
+SELECT * FROM pg_log_errors_db_ratio(0);
+-- Log volume by message format
+SELECT 'x'::integer;
+SELECT pg_sleep(1.5);
+SELECT type, sqlstate, message, count, bytes > 0 AS has_bytes FROM pg_log_errors_volume(360) WHERE sqlstate = '22P02';
+SELECT * FROM pg_log_errors_volume(-1);
+-- Errors never seen before
+SELECT * FROM logerrors_missing;
+SELECT type, sqlstate, username, database, message FROM pg_log_errors_novel() WHERE sqlstate = '42P01';
+-- Burst of warnings after a few quiet intervals of their key (anomaly_min_samples is 2)
+SET client_min_messages = error;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE WARNING 'logerrors anomaly';
+END;
+$$;
+SELECT pg_sleep(3);
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1..50 LOOP
+        RAISE WARNING 'logerrors anomaly';
+    END LOOP;
+END;
+$$;
+RESET client_min_messages;
+SELECT pg_sleep(1.5);
+SELECT type, sqlstate, username, max(score) >= 4 AS flagged FROM pg_log_errors_anomalies() WHERE sqlstate = '01000' GROUP BY 1, 2, 3;
+-- Slow statements by database, user and application
+RESET ROLE;
+SET log_min_duration_statement = 100;
+SET ROLE postgres;
+SELECT pg_sleep(0.2);
+RESET ROLE;
+RESET log_min_duration_statement;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT database, username, sum(slow_count) AS slow_count FROM pg_slow_log_stats(360) WHERE username = 'postgres' GROUP BY 1, 2;
+SELECT * FROM pg_slow_log_stats(0);
+-- Slowest statements
+RESET ROLE;
+SET log_min_duration_statement = 100;
+SET ROLE postgres;
+SELECT pg_sleep(0.3);
+RESET ROLE;
+RESET log_min_duration_statement;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT duration >= 300 AS slow, database, username FROM pg_slow_log_top(360) WHERE query LIKE 'SELECT pg_sleep(0.3)%';
+SELECT * FROM pg_slow_log_top(-1);
+-- Export file read by the reference reader, tools are built by make in LOGERRORS_TOOLS
+\set tools_dir `echo "$LOGERRORS_TOOLS"`
+RESET ROLE;
+CREATE TEMP TABLE logerrors_output (line text);
+SELECT :'tools_dir' || '/logerrors_export_reader logerrors.export' AS reader \gset
+COPY logerrors_output FROM PROGRAM :'reader';
+SELECT count(*) FROM logerrors_output WHERE line LIKE '# updated_at_us=% interval_ms=1000 intervals_count=360';
+SELECT split_part(line, ' ', 1) AS type, split_part(line, ' ', 2) AS sqlstate, split_part(line, ' ', 6)::integer > 0 AS counted FROM logerrors_output WHERE line LIKE 'ERROR 22012 %';
+SET ROLE postgres;
+-- Counters pushed to unix datagram socket
+RESET ROLE;
+SELECT :'tools_dir' || '/logerrors_push_receiver -t 2 logerrors.sock > logerrors.push 2>&1 < /dev/null &' AS receiver \gset
+COPY (SELECT 1) TO PROGRAM :'receiver';
+SELECT pg_sleep(0.2);
+SET ROLE postgres;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE SQLSTATE 'LP001';
+END;
+$$;
+SELECT pg_sleep(2.2);
+RESET ROLE;
+SELECT split_part(line, '|', 1) AS counter, split_part(line, '|', 2) AS kind FROM regexp_split_to_table(pg_read_file('logerrors.push'), E'\n') AS line WHERE line LIKE 'logerrors.%.LP001:%';
+SET ROLE postgres;
+-- node_exporter textfile
+RESET ROLE;
+SELECT line FROM regexp_split_to_table(pg_read_file('prometheus/logerrors.prom'), E'\n') AS line WHERE line LIKE '# TYPE %' ORDER BY 1;
+SELECT split_part(line, ',db_oid', 1) AS metric FROM regexp_split_to_table(pg_read_file('prometheus/logerrors.prom'), E'\n') AS line WHERE line LIKE 'logerrors_window_messages{window="long",type="ERROR",sqlstate="22012",%';
+SET ROLE postgres;
+-- Waiting for a key to reach threshold in current interval
+RESET ROLE;
+CREATE FUNCTION logerrors_warn_and_wait() RETURNS SETOF text LANGUAGE plpgsql AS $$
+BEGIN
+    RAISE WARNING 'logerrors wait';
+    RETURN QUERY SELECT type || ' ' || sqlstate FROM pg_log_errors_wait(1, 10000, '01000');
+END;
+$$;
+SET ROLE postgres;
+SET client_min_messages = error;
+SELECT * FROM logerrors_warn_and_wait();
+RESET client_min_messages;
+SELECT count(*) FROM pg_log_errors_wait(1000000, 100, '01');
+SELECT * FROM pg_log_errors_wait(0, 100);
+SELECT * FROM pg_log_errors_wait(1, 100, '0');
+-- Slots of waiters canceled while waiting are released, more times than there are slots
+RESET ROLE;
+SET statement_timeout = 50;
+SELECT 'SELECT * FROM pg_log_errors_wait(1000000, 60000, ''LT001'')' FROM generate_series(1, 33) \gexec
+RESET statement_timeout;
+SELECT count(*) FROM pg_log_errors_wait(1000000, 0);
+SET ROLE postgres;
+-- Offline counting of csvlog file
+RESET ROLE;
+GRANT pg_read_server_files TO postgres;
+SELECT current_setting('data_directory') || '/logerrors_ingest.csv' AS ingest_path \gset
+COPY (VALUES ('2024-01-01 10:00:05 UTC', 'app', 'shop', '', '', '', '', '', '', '', '', 'ERROR', '23505', 'duplicate key value'),
+             ('2024-01-01 10:00:40 UTC', 'app', 'shop', '', '', '', '', '', '', '', '', 'ERROR', '23505', 'duplicate key value'),
+             ('2024-01-01 10:01:10 UTC', 'app', 'shop', '', '', '', '', '', '', '', '', 'FATAL', '28P01', 'password authentication failed'))
+    TO :'ingest_path' WITH (FORMAT csv);
+SET ROLE logerrors_nobody;
+SELECT * FROM pg_log_errors_ingest('logerrors_ingest.csv');
+SET ROLE postgres;
+SELECT "time" - '2024-01-01 10:00:00 UTC' AS period_end, type, sqlstate, username, database, count FROM pg_log_errors_ingest('logerrors_ingest.csv', 60, 'csv') ORDER BY 1;
+SELECT * FROM pg_log_errors_ingest('logerrors_ingest.csv', 0);
+-- Persisted errors file queried by logerrors_stat
+RESET ROLE;
+SELECT current_setting('data_directory') || '/errors-2024-01-01.csv' AS errors_path \gset
+COPY (VALUES ('2024-01-01 10:00:05.000000 UTC', 'ERROR', '23505', 'shop', 'app', 2),
+             ('2024-01-01 10:30:00.000000 UTC', 'ERROR', '23505', 'shop', 'app', 3),
+             ('2024-01-01 10:45:00.000000 UTC', 'FATAL', '28P01', 'shop', 'app', 1),
+             ('2024-01-01 11:00:00.000000 UTC', 'ERROR', '42703', 'shop', 'app', 7))
+    TO :'errors_path' WITH (FORMAT csv);
+SELECT :'tools_dir' || '/logerrors_stat -d . -s "2024-01-01 10:00" -e "2024-01-01 11:00" -f csv' AS stat_command \gset
+TRUNCATE logerrors_output;
+COPY logerrors_output FROM PROGRAM :'stat_command';
+SELECT * FROM logerrors_output;
+SET ROLE postgres;
+-- Errors by class of statement
+RESET ROLE;
+SET logerrors.track_statement_class = on;
+SET ROLE postgres;
+SELECT 1/0;
+INSERT INTO logerrors_items VALUES (1, 1);
+RESET ROLE;
+RESET logerrors.track_statement_class;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT statement_class, type, sqlstate, count FROM pg_log_errors_statements(360) ORDER BY statement_class;
+-- Errors by innermost PL/pgSQL function
+RESET ROLE;
+CREATE FUNCTION logerrors_fail(n integer) RETURNS integer LANGUAGE plpgsql AS $$
+BEGIN
+    RAISE EXCEPTION 'logerrors failure %', n;
+END;
+$$;
+CREATE FUNCTION logerrors_outer() RETURNS integer LANGUAGE plpgsql AS $$
+BEGIN
+    RETURN logerrors_fail(2);
+END;
+$$;
+CREATE FUNCTION logerrors_catch() RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+    PERFORM logerrors_fail(3);
+EXCEPTION WHEN OTHERS THEN
+    NULL;
+END;
+$$;
+SET logerrors.track_plfunctions = on;
+SET ROLE postgres;
+SELECT logerrors_fail(1);
+SELECT logerrors_outer();
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE EXCEPTION 'logerrors block failure';
+END;
+$$;
+-- Caught error is not taken for the next one
+SELECT logerrors_catch();
+SELECT 1/0;
+RESET ROLE;
+RESET logerrors.track_plfunctions;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT function_name, function_oid = 'logerrors_fail(integer)'::regprocedure AS same_oid, type, sqlstate, count FROM pg_log_errors_plfunctions(360) ORDER BY function_name;
+-- Warnings above sampling threshold are counted by sampling
+RESET ROLE;
+SET logerrors.sampling_threshold = 1;
+SET ROLE postgres;
+SET client_min_messages = error;
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR i IN 1..1000 LOOP
+        RAISE WARNING 'logerrors sampling';
+    END LOOP;
+END;
+$$;
+RESET client_min_messages;
+RESET ROLE;
+RESET logerrors.sampling_threshold;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT time_interval, sampled > 0 AS sampled, stddev > 0 AS has_stddev FROM pg_log_errors_accuracy(360);
+SELECT * FROM pg_log_errors_accuracy(-5);
+-- Times of messages are not kept without logerrors.track_times
+SELECT bool_and(first_seen IS NULL AND last_seen IS NULL) AS untracked FROM pg_log_errors_stats();
+-- Counters published as logical decoding messages
+RESET ROLE;
+\c postgres
+SELECT 'init' FROM pg_create_logical_replication_slot('logerrors_slot', 'pgoutput');
+CREATE PUBLICATION logerrors_pub;
+\c contrib_regression
+SET ROLE postgres;
+DO LANGUAGE plpgsql $$
+BEGIN
+    RAISE SQLSTATE 'LM001';
+END;
+$$;
+SELECT pg_sleep(1.5);
+\c postgres
+SELECT count(*) > 0 AS published, bool_or(position('LM001'::bytea IN substr(data, 25)) > 0) AS has_record
+    FROM pg_logical_slot_peek_binary_changes('logerrors_slot', NULL, NULL, 'proto_version', '1', 'publication_names', 'logerrors_pub', 'messages', 'true')
+    WHERE get_byte(data, 0) = ascii('M') AND substr(data, 11, 10) = 'logerrors\000'::bytea;
+SELECT pg_drop_replication_slot('logerrors_slot');
+DROP PUBLICATION logerrors_pub;
+\c contrib_regression
+SET ROLE postgres;
+-- Sums of more keys than one chunk holds
+RESET ROLE;
+SET logerrors.track_locations = on;
+SET ROLE postgres;
+SET client_min_messages = error;
+DO LANGUAGE plpgsql $$
+BEGIN
+    FOR j IN 1..2 LOOP
+        FOR i IN 1..300 LOOP
+            RAISE WARNING USING ERRCODE = 'V' || lpad(i::text, 4, '0');
+        END LOOP;
+    END LOOP;
+END;
+$$;
+RESET client_min_messages;
+RESET ROLE;
+RESET logerrors.track_locations;
+SET ROLE postgres;
+SELECT pg_sleep(1.5);
+SELECT count(*) AS keys, sum(count) AS count FROM pg_log_errors_stats() WHERE time_interval = 360 AND sqlstate LIKE 'V%';
+SELECT count(DISTINCT sqlstate) AS keys, sum(count) AS count FROM pg_log_errors_volume(360) WHERE sqlstate LIKE 'V%';
+SELECT count(DISTINCT sqlstate) AS keys, sum(count) AS count FROM pg_log_errors_locations() WHERE time_interval = 360 AND sqlstate LIKE 'V%';
+-- Roles are shared by the cluster and files by later runs of logerrors_stat
+RESET ROLE;
+COPY (SELECT 1) TO PROGRAM 'rm -f logerrors_ingest.csv errors-2024-01-01.csv logerrors.push';
+REVOKE pg_read_server_files FROM postgres;
+REVOKE pg_monitor FROM postgres;
+DROP ROLE logerrors_nobody;
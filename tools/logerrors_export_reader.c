@@ -0,0 +1,106 @@
+/*
+ * Reference reader of logerrors.export_file, see logerrors_export.h.
+ *
+ * Usage: logerrors_export_reader FILE
+ * Prints one line per record: type, sqlstate, database oid, user oid,
+ * count of last interval and count of all intervals of buffer.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logerrors_export.h"
+
+/* Copy consistent snapshot of mapped file to buf, returns 0 on success */
+static int
+read_snapshot(const char *map, char *buf, int max_attempts)
+{
+    const LogerrorsExportHeader *shared = (const LogerrorsExportHeader *) map;
+    LogerrorsExportHeader *header = (LogerrorsExportHeader *) buf;
+    uint64_t before;
+    uint64_t after;
+    uint32_t records_count;
+    int attempt;
+
+    for (attempt = 0; attempt < max_attempts; ++attempt) {
+        before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before % 2 != 0) {
+            usleep(1000);
+            continue;
+        }
+        memcpy(header, map, sizeof(LogerrorsExportHeader));
+        records_count = header->records_count;
+        if (records_count > LOGERRORS_EXPORT_MAX_RECORDS)
+            records_count = LOGERRORS_EXPORT_MAX_RECORDS;
+        memcpy(buf + sizeof(LogerrorsExportHeader), map + sizeof(LogerrorsExportHeader),
+               sizeof(LogerrorsExportRecord) * records_count);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+        if (before == after)
+            return 0;
+    }
+    return -1;
+}
+
+int
+main(int argc, char **argv)
+{
+    int fd;
+    struct stat st;
+    char *map;
+    char *buf;
+    LogerrorsExportHeader *header;
+    LogerrorsExportRecord *records;
+    uint32_t i;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s FILE\n", argv[0]);
+        return 2;
+    }
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "could not open \"%s\": %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    if ((size_t) st.st_size < LOGERRORS_EXPORT_FILE_SIZE) {
+        fprintf(stderr, "file \"%s\" is too small\n", argv[1]);
+        return 1;
+    }
+    map = mmap(NULL, LOGERRORS_EXPORT_FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "could not map \"%s\": %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    buf = malloc(LOGERRORS_EXPORT_FILE_SIZE);
+    if (buf == NULL || read_snapshot(map, buf, 100) != 0) {
+        fprintf(stderr, "could not read consistent snapshot\n");
+        return 1;
+    }
+    header = (LogerrorsExportHeader *) buf;
+    if (header->magic != LOGERRORS_EXPORT_MAGIC || header->version != LOGERRORS_EXPORT_VERSION ||
+        header->header_size != sizeof(LogerrorsExportHeader) ||
+        header->record_size != sizeof(LogerrorsExportRecord)) {
+        fprintf(stderr, "unsupported file format\n");
+        return 1;
+    }
+    records = (LogerrorsExportRecord *) (buf + sizeof(LogerrorsExportHeader));
+
+    printf("# updated_at_us=%lld interval_ms=%u intervals_count=%u\n",
+           (long long) header->updated_at, header->interval_ms, header->intervals_count);
+    printf("# warning=%llu error=%llu fatal=%llu slow=%llu dropped=%llu truncated=%llu\n",
+           (unsigned long long) header->total_warning, (unsigned long long) header->total_error,
+           (unsigned long long) header->total_fatal, (unsigned long long) header->total_slow,
+           (unsigned long long) header->dropped, (unsigned long long) header->truncated);
+    for (i = 0; i < header->records_count; ++i)
+        printf("%s %s %u %u %u %u\n", records[i].type, records[i].sqlstate, records[i].db_oid,
+               records[i].user_oid, records[i].short_count, records[i].long_count);
+    free(buf);
+    munmap(map, LOGERRORS_EXPORT_FILE_SIZE);
+    return 0;
+}
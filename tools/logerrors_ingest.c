@@ -0,0 +1,408 @@
+/*
+ * Offline ingestion of csvlog/jsonlog files into logerrors statistics.
+ *
+ * Usage: logerrors_ingest [-i seconds] [-j threads] [-f csv|json] [-o dir] FILE...
+ *
+ * Files are mapped and parsed in parallel, each thread counts messages of its
+ * files in its own hash table, tables are merged at the end. Messages are
+ * counted by period of -i seconds (60 by default, like stats persistence
+ * interval), type, sqlstate, database and user.
+ *
+ * Without -o prints lines of errors files to stdout. With -o appends lines to
+ * stats-YYYY-MM-DD.ingest.csv and errors-YYYY-MM-DD.ingest.csv in dir, in the
+ * same format as the bgworker writes them. Time of line is the end of its
+ * period. Backfilled lines are older than lines of the bgworker, so they go
+ * to their own files to keep files of the bgworker in time order.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logparse.h"
+
+#define NAME_LENGTH	64
+#define ZONE_LENGTH	16
+
+static const char *type_names[LOGPARSE_TYPES_COUNT] = {"WARNING", "ERROR", "FATAL", "SLOW"};
+
+typedef struct count_key {
+    int64_t period_end;
+    char zone[ZONE_LENGTH];
+    int type;
+    char sqlstate[8];
+    char database[NAME_LENGTH];
+    char user[NAME_LENGTH];
+} CountKey;
+
+typedef struct count_entry {
+    CountKey key;
+    uint64_t count;
+    int used;
+} CountEntry;
+
+/* Open addressing hash table, one per thread */
+typedef struct count_table {
+    CountEntry *entries;
+    size_t size;
+    size_t used;
+} CountTable;
+
+typedef struct worker {
+    pthread_t thread;
+    CountTable table;
+    uint64_t records;
+    int failed;
+} Worker;
+
+static int period = 60;
+static LogparseFormat forced_format;
+static int format_forced = 0;
+static char **files;
+static int files_count;
+static int next_file = 0;
+static pthread_mutex_t next_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+hash_key(const CountKey *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < sizeof(CountKey); ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void
+table_init(CountTable *table, size_t size)
+{
+    table->entries = calloc(size, sizeof(CountEntry));
+    if (table->entries == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    table->size = size;
+    table->used = 0;
+}
+
+static void table_add(CountTable *table, const CountKey *key, uint64_t count);
+
+static void
+table_grow(CountTable *table)
+{
+    CountTable grown;
+    size_t i;
+    table_init(&grown, table->size * 2);
+    for (i = 0; i < table->size; ++i) {
+        if (table->entries[i].used)
+            table_add(&grown, &table->entries[i].key, table->entries[i].count);
+    }
+    free(table->entries);
+    *table = grown;
+}
+
+static void
+table_add(CountTable *table, const CountKey *key, uint64_t count)
+{
+    size_t i;
+    CountEntry *entry;
+
+    if (table->used * 2 >= table->size)
+        table_grow(table);
+    i = hash_key(key) & (table->size - 1);
+    for (;;) {
+        entry = &table->entries[i];
+        if (!entry->used) {
+            entry->used = 1;
+            entry->key = *key;
+            entry->count = count;
+            table->used++;
+            return;
+        }
+        if (memcmp(&entry->key, key, sizeof(CountKey)) == 0) {
+            entry->count += count;
+            return;
+        }
+        i = (i + 1) & (table->size - 1);
+    }
+}
+
+static void
+copy_field(char *buf, size_t size, const LogparseField *field)
+{
+    size_t len = field->len < size - 1 ? field->len : size - 1;
+    memcpy(buf, field->data, len);
+    buf[len] = '\0';
+}
+
+static void
+count_record(const LogparseRecord *record, void *arg)
+{
+    Worker *worker = (Worker *) arg;
+    CountKey key;
+    LogparseField zone;
+    int64_t seconds;
+    int type;
+
+    type = logparse_record_type(record);
+    if (type < 0 || logparse_time(&record->time, &seconds, &zone) != 0)
+        return;
+    memset(&key, 0, sizeof(key));
+    key.period_end = (seconds >= 0 ? seconds / period : (seconds - period + 1) / period) * period + period;
+    copy_field(key.zone, sizeof(key.zone), &zone);
+    key.type = type;
+    if (type != LOGPARSE_SLOW)
+        copy_field(key.sqlstate, sizeof(key.sqlstate), &record->sqlstate);
+    logparse_copy_unescaped(record, &record->database, key.database, sizeof(key.database));
+    logparse_copy_unescaped(record, &record->user, key.user, sizeof(key.user));
+    table_add(&worker->table, &key, 1);
+    worker->records++;
+}
+
+static int
+ingest_file(Worker *worker, const char *path)
+{
+    int fd;
+    struct stat st;
+    char *map;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "could not open \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "could not map \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    logparse_buffer(format_forced ? forced_format : logparse_guess_format(path), map, st.st_size,
+                    count_record, worker);
+    munmap(map, st.st_size);
+    return 0;
+}
+
+static void *
+worker_main(void *arg)
+{
+    Worker *worker = (Worker *) arg;
+    int file;
+
+    for (;;) {
+        pthread_mutex_lock(&next_file_lock);
+        file = next_file++;
+        pthread_mutex_unlock(&next_file_lock);
+        if (file >= files_count)
+            return NULL;
+        if (ingest_file(worker, files[file]) != 0)
+            worker->failed = 1;
+    }
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+    const CountKey *ka = &((const CountEntry *) a)->key;
+    const CountKey *kb = &((const CountEntry *) b)->key;
+    int cmp;
+    if (ka->period_end != kb->period_end)
+        return ka->period_end < kb->period_end ? -1 : 1;
+    if (ka->type != kb->type)
+        return ka->type - kb->type;
+    if ((cmp = strcmp(ka->sqlstate, kb->sqlstate)) != 0)
+        return cmp;
+    if ((cmp = strcmp(ka->database, kb->database)) != 0)
+        return cmp;
+    return strcmp(ka->user, kb->user);
+}
+
+/* Open ingest file of day of line in output directory, keeps the last one open */
+static FILE *
+open_day_file(const char *dir, const char *prefix, const char *time, char *current_path, FILE *current)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s-%.10s.ingest.csv", dir, prefix, time);
+    if (current != NULL && strcmp(path, current_path) == 0)
+        return current;
+    if (current != NULL)
+        fclose(current);
+    strcpy(current_path, path);
+    current = fopen(path, "a");
+    if (current == NULL) {
+        fprintf(stderr, "could not open \"%s\": %s\n", path, strerror(errno));
+        exit(1);
+    }
+    return current;
+}
+
+/* Name as CSV field, quoted when it has delimiters */
+static void
+write_csv_name(FILE *file, const char *name)
+{
+    if (strpbrk(name, ",\"\r\n") == NULL) {
+        fputs(name, file);
+        return;
+    }
+    fputc('"', file);
+    for (; *name; ++name) {
+        if (*name == '"')
+            fputc('"', file);
+        fputc(*name, file);
+    }
+    fputc('"', file);
+}
+
+static void
+write_output(CountEntry *entries, size_t count, const char *dir)
+{
+    char time[64];
+    char stats_path[4096] = "";
+    char errors_path[4096] = "";
+    FILE *stats = NULL;
+    FILE *errors = dir == NULL ? stdout : NULL;
+    uint64_t totals[LOGPARSE_TYPES_COUNT];
+    LogparseField zone;
+    size_t i;
+    size_t j;
+    int type;
+
+    for (i = 0; i < count; i = j) {
+        memset(totals, 0, sizeof(totals));
+        zone.data = entries[i].key.zone;
+        zone.len = strlen(entries[i].key.zone);
+        logparse_format_time(entries[i].key.period_end, &zone, time, sizeof(time));
+        for (j = i; j < count && entries[j].key.period_end == entries[i].key.period_end &&
+                    strcmp(entries[j].key.zone, entries[i].key.zone) == 0; ++j) {
+            totals[entries[j].key.type] += entries[j].count;
+            if (entries[j].key.type == LOGPARSE_SLOW)
+                continue;
+            if (dir != NULL)
+                errors = open_day_file(dir, "errors", time, errors_path, errors);
+            fprintf(errors, "%s,%s,%s,", time, type_names[entries[j].key.type], entries[j].key.sqlstate);
+            write_csv_name(errors, entries[j].key.database);
+            fputc(',', errors);
+            write_csv_name(errors, entries[j].key.user);
+            fprintf(errors, ",%llu\n", (unsigned long long) entries[j].count);
+        }
+        if (dir == NULL)
+            continue;
+        stats = open_day_file(dir, "stats", time, stats_path, stats);
+        fprintf(stats, "%s", time);
+        for (type = 0; type < LOGPARSE_TYPES_COUNT; ++type)
+            fprintf(stats, ",%llu", (unsigned long long) totals[type]);
+        fprintf(stats, ",0,0,0,0,0\n");
+    }
+    if (stats != NULL)
+        fclose(stats);
+    if (dir != NULL && errors != NULL)
+        fclose(errors);
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr, "usage: %s [-i seconds] [-j threads] [-f csv|json] [-o dir] FILE...\n", progname);
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    int threads_count = 0;
+    const char *dir = NULL;
+    Worker *workers;
+    CountTable merged;
+    CountEntry *entries;
+    size_t entries_count = 0;
+    uint64_t records = 0;
+    size_t i;
+    int t;
+    int opt;
+    int failed = 0;
+
+    while ((opt = getopt(argc, argv, "i:j:f:o:")) != -1) {
+        switch (opt) {
+            case 'i':
+                period = atoi(optarg);
+                if (period <= 0)
+                    usage(argv[0]);
+                break;
+            case 'j':
+                threads_count = atoi(optarg);
+                break;
+            case 'f':
+                format_forced = 1;
+                if (strcmp(optarg, "json") == 0)
+                    forced_format = LOGPARSE_JSON;
+                else if (strcmp(optarg, "csv") == 0)
+                    forced_format = LOGPARSE_CSV;
+                else
+                    usage(argv[0]);
+                break;
+            case 'o':
+                dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    files = argv + optind;
+    files_count = argc - optind;
+    if (files_count == 0)
+        usage(argv[0]);
+    if (threads_count <= 0)
+        threads_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads_count > files_count)
+        threads_count = files_count;
+    if (threads_count <= 0)
+        threads_count = 1;
+
+    workers = calloc(threads_count, sizeof(Worker));
+    for (t = 0; t < threads_count; ++t) {
+        table_init(&workers[t].table, 1024);
+        if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0) {
+            fprintf(stderr, "could not create thread\n");
+            return 1;
+        }
+    }
+    table_init(&merged, 1024);
+    for (t = 0; t < threads_count; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        for (i = 0; i < workers[t].table.size; ++i) {
+            if (workers[t].table.entries[i].used)
+                table_add(&merged, &workers[t].table.entries[i].key, workers[t].table.entries[i].count);
+        }
+        records += workers[t].records;
+        failed |= workers[t].failed;
+        free(workers[t].table.entries);
+    }
+
+    entries = malloc(sizeof(CountEntry) * (merged.used + 1));
+    for (i = 0; i < merged.size; ++i) {
+        if (merged.entries[i].used)
+            entries[entries_count++] = merged.entries[i];
+    }
+    qsort(entries, entries_count, sizeof(CountEntry), compare_entries);
+    write_output(entries, entries_count, dir);
+    fprintf(stderr, "%llu messages counted from %d files\n", (unsigned long long) records, files_count);
+    free(entries);
+    free(merged.entries);
+    free(workers);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Local receiver of counters pushed to logerrors.push_socket.
+ *
+ * Usage: logerrors_push_receiver [-t seconds] SOCKET
+ * Binds unix datagram socket SOCKET and prints received statsd lines as they
+ * come. With -t exits after that many seconds, otherwise runs until killed.
+ * The socket file is removed on exit.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Larger than datagrams of the bgworker */
+#define RECEIVE_BUFFER_SIZE	65536
+
+static volatile sig_atomic_t stopped = 0;
+
+static void
+stop_handler(int signo)
+{
+    (void) signo;
+    stopped = 1;
+}
+
+/* Milliseconds left until deadline, -1 without deadline */
+static int
+time_left(const struct timespec *deadline)
+{
+    struct timespec now;
+    long left;
+
+    if (deadline->tv_sec == 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return left > 0 ? (int) left : 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    struct timespec deadline = {0, 0};
+    struct pollfd pfd;
+    char *buf;
+    ssize_t len;
+    int fd;
+    int opt;
+    int timeout;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        if (opt != 't') {
+            fprintf(stderr, "usage: %s [-t seconds] SOCKET\n", argv[0]);
+            return 2;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += atoi(optarg);
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-t seconds] SOCKET\n", argv[0]);
+        return 2;
+    }
+    if (strlen(argv[optind]) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path \"%s\" is too long\n", argv[optind]);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, argv[optind]);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "could not create socket: %s\n", strerror(errno));
+        return 1;
+    }
+    /* Left by a receiver which was killed */
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "could not bind \"%s\": %s\n", addr.sun_path, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, stop_handler);
+    signal(SIGTERM, stop_handler);
+    buf = malloc(RECEIVE_BUFFER_SIZE);
+    if (buf == NULL) {
+        fprintf(stderr, "out of memory\n");
+        unlink(addr.sun_path);
+        return 1;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (!stopped && (timeout = time_left(&deadline)) != 0) {
+        if (poll(&pfd, 1, timeout) <= 0)
+            continue;
+        len = recv(fd, buf, RECEIVE_BUFFER_SIZE, 0);
+        if (len <= 0)
+            continue;
+        /* Lines of datagram end with newline */
+        fwrite(buf, 1, len, stdout);
+        fflush(stdout);
+    }
+    free(buf);
+    close(fd);
+    unlink(addr.sun_path);
+    return 0;
+}
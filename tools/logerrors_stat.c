@@ -0,0 +1,732 @@
+/*
+ * Query persisted logerrors stats files without a running server.
+ *
+ * Usage: logerrors_stat [-d dir] [-s start] [-e end] [-r errors|totals]
+ *                       [-n top] [-f table|csv|json] [-j threads] [-m names]
+ *
+ * Reads errors-YYYY-MM-DD.csv (per key counts) or stats-YYYY-MM-DD.csv
+ * (totals by type) written by the bgworker in dir ($PGDATA/pg_stat_tmp/stats
+ * usually, current directory by default), and the same files with .ingest.csv
+ * suffix written by logerrors_ingest. Start and end are local times
+ * "YYYY-MM-DD[ HH:MM[:SS]]", a line counts if start <= time < end. Only files
+ * of days in range are opened. The bgworker appends lines in time order, so
+ * the first line of range is found by binary search in the mapped file.
+ * Repeated backfills leave ingest files unordered, they are scanned whole.
+ * Files are aggregated in parallel, each thread in its own hash table, tables
+ * are merged at the end.
+ *
+ * The bgworker writes database and user oids, logerrors_ingest writes names
+ * from log files. With -m names file of "database,oid,name" and
+ * "user,oid,name" lines oids are replaced by names when tables are merged, so
+ * both count under one key. It can be made on the server by
+ *   COPY (SELECT 'database', oid, datname FROM pg_database
+ *         UNION ALL SELECT 'user', oid, rolname FROM pg_roles) TO STDOUT (FORMAT csv)
+ *
+ * Example, top errors yesterday between 14:00 and 15:00:
+ *   logerrors_stat -d $PGDATA/pg_stat_tmp/stats -s "2020-06-12 14:00" -e "2020-06-12 15:00"
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NAME_LENGTH	64
+/* "YYYY-MM-DD HH:MM:SS" */
+#define TIME_LENGTH	19
+#define DATE_LENGTH	10
+#define INGEST_SUFFIX	".ingest.csv"
+#define TOTALS_COUNT	4
+
+static const char *totals_names[TOTALS_COUNT] = {"WARNING", "ERROR", "FATAL", "SLOW"};
+
+typedef enum report {
+    REPORT_ERRORS,
+    REPORT_TOTALS
+} Report;
+
+typedef enum output_format {
+    OUTPUT_TABLE,
+    OUTPUT_CSV,
+    OUTPUT_JSON
+} OutputFormat;
+
+typedef struct stat_key {
+    char type[8];
+    char sqlstate[8];
+    char database[NAME_LENGTH];
+    char user[NAME_LENGTH];
+} StatKey;
+
+typedef struct stat_entry {
+    StatKey key;
+    uint64_t count;
+    int used;
+} StatEntry;
+
+/* Open addressing hash table, one per thread */
+typedef struct stat_table {
+    StatEntry *entries;
+    size_t size;
+    size_t used;
+} StatTable;
+
+typedef struct worker {
+    pthread_t thread;
+    StatTable table;
+    uint64_t totals[TOTALS_COUNT];
+    uint64_t lines;
+    int failed;
+} Worker;
+
+static Report report = REPORT_ERRORS;
+static char start_time[TIME_LENGTH + 1] = "0000-00-00 00:00:00";
+static char end_time[TIME_LENGTH + 1] = "9999-99-99 99:99:99";
+static char **files;
+static int files_count = 0;
+static int next_file = 0;
+static pthread_mutex_t next_file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Names of oids loaded with -m */
+typedef struct oid_name {
+    int is_user;
+    char oid[NAME_LENGTH];
+    char name[NAME_LENGTH];
+} OidName;
+
+static OidName *oid_names = NULL;
+static size_t oid_names_count = 0;
+
+static uint64_t
+hash_key(const StatKey *key)
+{
+    const unsigned char *p = (const unsigned char *) key;
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < sizeof(StatKey); ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void
+table_init(StatTable *table, size_t size)
+{
+    table->entries = calloc(size, sizeof(StatEntry));
+    if (table->entries == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    table->size = size;
+    table->used = 0;
+}
+
+static void table_add(StatTable *table, const StatKey *key, uint64_t count);
+
+static void
+table_grow(StatTable *table)
+{
+    StatTable grown;
+    size_t i;
+    table_init(&grown, table->size * 2);
+    for (i = 0; i < table->size; ++i) {
+        if (table->entries[i].used)
+            table_add(&grown, &table->entries[i].key, table->entries[i].count);
+    }
+    free(table->entries);
+    *table = grown;
+}
+
+static void
+table_add(StatTable *table, const StatKey *key, uint64_t count)
+{
+    size_t i;
+    StatEntry *entry;
+
+    if (table->used * 2 >= table->size)
+        table_grow(table);
+    i = hash_key(key) & (table->size - 1);
+    for (;;) {
+        entry = &table->entries[i];
+        if (!entry->used) {
+            entry->used = 1;
+            entry->key = *key;
+            entry->count = count;
+            table->used++;
+            return;
+        }
+        if (memcmp(&entry->key, key, sizeof(StatKey)) == 0) {
+            entry->count += count;
+            return;
+        }
+        i = (i + 1) & (table->size - 1);
+    }
+}
+
+/*
+ * Normalize "YYYY-MM-DD[ HH:MM[:SS]]" to full length, missing parts are
+ * filled with zeros. Returns 0 on success.
+ */
+static int
+parse_time_arg(const char *arg, char *time)
+{
+    static const char *pattern = "dddd-dd-dd dd:dd:dd";
+    size_t len = strlen(arg);
+    size_t i;
+
+    if (len != DATE_LENGTH && len != 16 && len != TIME_LENGTH)
+        return -1;
+    for (i = 0; i < len; ++i) {
+        if (pattern[i] == 'd' ? (arg[i] < '0' || arg[i] > '9') : arg[i] != pattern[i])
+            return -1;
+    }
+    memcpy(time, "0000-00-00 00:00:00", TIME_LENGTH + 1);
+    memcpy(time, arg, len);
+    return 0;
+}
+
+/* Start of line after p, or end */
+static const char *
+next_line(const char *p, const char *end)
+{
+    const char *q = memchr(p, '\n', end - p);
+    return q == NULL ? end : q + 1;
+}
+
+/* Compare time of line with time, lines shorter than time are smaller */
+static int
+compare_line_time(const char *line, const char *end, const char *time)
+{
+    if (end - line < TIME_LENGTH)
+        return -1;
+    return memcmp(line, time, TIME_LENGTH);
+}
+
+/* First line with time >= start_time */
+static const char *
+seek_start(const char *data, const char *end)
+{
+    const char *low = data;
+    const char *high = end;
+    const char *mid;
+    const char *line;
+
+    /* Invariant: lines before low are earlier, line at high (if any) is not */
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        /* Line containing mid starts after previous newline */
+        line = mid;
+        while (line > low && line[-1] != '\n')
+            line--;
+        if (compare_line_time(line, end, start_time) < 0)
+            low = next_line(line, end);
+        else
+            high = line;
+    }
+    return low;
+}
+
+/* End of line starting at p, names quoted as in CSV may contain newlines */
+static const char *
+find_line_end(const char *p, const char *end)
+{
+    const char *line_end = memchr(p, '\n', end - p);
+    int quoted = 0;
+
+    if (line_end == NULL)
+        line_end = end;
+    p = memchr(p, '"', line_end - p);
+    if (p == NULL)
+        return line_end;
+    for (; p < end; ++p) {
+        if (*p == '"')
+            quoted = !quoted;
+        else if (*p == '\n' && !quoted)
+            return p;
+    }
+    return end;
+}
+
+/*
+ * Copy next comma separated field of line to buf, truncated to its size.
+ * Quoted field may contain commas, newlines and doubled quotes. Returns
+ * position after delimiter.
+ */
+static const char *
+next_field(const char *p, const char *line_end, char *buf, size_t size)
+{
+    size_t len = 0;
+    int quoted = p < line_end && *p == '"';
+
+    if (quoted)
+        p++;
+    for (; p < line_end; ++p) {
+        if (quoted && *p == '"') {
+            if (p + 1 == line_end || p[1] != '"') {
+                quoted = 0;
+                continue;
+            }
+            p++;
+        } else if (!quoted && *p == ',')
+            break;
+        if (len < size - 1)
+            buf[len++] = *p;
+    }
+    buf[len] = '\0';
+    return p < line_end ? p + 1 : line_end;
+}
+
+/* time,type,sqlstate,database,user,count */
+static void
+count_errors_line(Worker *worker, const char *p, const char *line_end)
+{
+    StatKey key;
+    char field[32];
+
+    memset(&key, 0, sizeof(key));
+    p = next_field(p, line_end, field, sizeof(field));
+    p = next_field(p, line_end, key.type, sizeof(key.type));
+    p = next_field(p, line_end, key.sqlstate, sizeof(key.sqlstate));
+    p = next_field(p, line_end, key.database, sizeof(key.database));
+    p = next_field(p, line_end, key.user, sizeof(key.user));
+    next_field(p, line_end, field, sizeof(field));
+    table_add(&worker->table, &key, strtoull(field, NULL, 10));
+}
+
+/* time,warning,error,fatal,slow,... */
+static void
+count_totals_line(Worker *worker, const char *p, const char *line_end)
+{
+    char field[32];
+    int i;
+
+    p = next_field(p, line_end, field, sizeof(field));
+    for (i = 0; i < TOTALS_COUNT; ++i) {
+        p = next_field(p, line_end, field, sizeof(field));
+        if (field[0] != '\0')
+            worker->totals[i] += strtoull(field, NULL, 10);
+    }
+}
+
+static int
+scan_file(Worker *worker, const char *path)
+{
+    int fd;
+    struct stat st;
+    char *map;
+    const char *p;
+    const char *end;
+    const char *line_end;
+    size_t path_len = strlen(path);
+    int sorted;
+
+    /* Only files of the bgworker are in time order */
+    sorted = path_len < strlen(INGEST_SUFFIX) ||
+             strcmp(path + path_len - strlen(INGEST_SUFFIX), INGEST_SUFFIX) != 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "could not open \"%s\": %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "could not map \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    end = map + st.st_size;
+    for (p = sorted ? seek_start(map, end) : map; p < end; p = line_end + 1) {
+        line_end = find_line_end(p, end);
+        if (line_end - p < TIME_LENGTH)
+            continue;
+        if (compare_line_time(p, line_end, end_time) >= 0) {
+            if (sorted)
+                break;
+            continue;
+        }
+        if (!sorted && compare_line_time(p, line_end, start_time) < 0)
+            continue;
+        if (report == REPORT_ERRORS)
+            count_errors_line(worker, p, line_end);
+        else
+            count_totals_line(worker, p, line_end);
+        worker->lines++;
+    }
+    munmap(map, st.st_size);
+    return 0;
+}
+
+static void *
+worker_main(void *arg)
+{
+    Worker *worker = (Worker *) arg;
+    int file;
+
+    for (;;) {
+        pthread_mutex_lock(&next_file_lock);
+        file = next_file++;
+        pthread_mutex_unlock(&next_file_lock);
+        if (file >= files_count)
+            return NULL;
+        if (scan_file(worker, files[file]) != 0)
+            worker->failed = 1;
+    }
+}
+
+/* Load names file of -m, lines are "database|user,oid,name" */
+static void
+load_oid_names(const char *path)
+{
+    FILE *file;
+    char *data;
+    long size;
+    const char *p;
+    const char *end;
+    const char *line_end;
+    char field[16];
+    size_t allocated = 64;
+    OidName *oid_name;
+
+    file = fopen(path, "rb");
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "could not open \"%s\": %s\n", path, strerror(errno));
+        exit(1);
+    }
+    data = malloc(size + 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t) size) {
+        fprintf(stderr, "could not read \"%s\"\n", path);
+        exit(1);
+    }
+    fclose(file);
+    oid_names = malloc(sizeof(OidName) * allocated);
+    end = data + size;
+    for (p = data; p < end; p = line_end + 1) {
+        line_end = find_line_end(p, end);
+        if (oid_names_count == allocated) {
+            allocated *= 2;
+            oid_names = realloc(oid_names, sizeof(OidName) * allocated);
+        }
+        oid_name = &oid_names[oid_names_count];
+        p = next_field(p, line_end, field, sizeof(field));
+        if (strcmp(field, "user") == 0)
+            oid_name->is_user = 1;
+        else if (strcmp(field, "database") == 0)
+            oid_name->is_user = 0;
+        else
+            continue;
+        p = next_field(p, line_end, oid_name->oid, sizeof(oid_name->oid));
+        next_field(p, line_end, oid_name->name, sizeof(oid_name->name));
+        oid_names_count++;
+    }
+    free(data);
+}
+
+/* Replace oid by its name, names of ingested lines are kept */
+static void
+map_oid_name(char *value, size_t size, int is_user)
+{
+    size_t i;
+    for (i = 0; i < oid_names_count; ++i) {
+        if (oid_names[i].is_user == is_user && strcmp(oid_names[i].oid, value) == 0) {
+            snprintf(value, size, "%s", oid_names[i].name);
+            return;
+        }
+    }
+}
+
+/* Files "<prefix>-YYYY-MM-DD.csv" and "<prefix>-YYYY-MM-DD.ingest.csv" of dir with days in range */
+static void
+find_files(const char *dir, const char *prefix)
+{
+    DIR *d;
+    struct dirent *de;
+    size_t prefix_len = strlen(prefix);
+    size_t allocated = 16;
+    const char *date;
+    char *path;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "could not open directory \"%s\": %s\n", dir, strerror(errno));
+        exit(1);
+    }
+    files = malloc(sizeof(char *) * allocated);
+    while ((de = readdir(d)) != NULL) {
+        if (strlen(de->d_name) < prefix_len + 1 + DATE_LENGTH ||
+            strncmp(de->d_name, prefix, prefix_len) != 0 || de->d_name[prefix_len] != '-' ||
+            (strcmp(de->d_name + prefix_len + 1 + DATE_LENGTH, ".csv") != 0 &&
+             strcmp(de->d_name + prefix_len + 1 + DATE_LENGTH, INGEST_SUFFIX) != 0))
+            continue;
+        date = de->d_name + prefix_len + 1;
+        /* Day of file may have lines in range only if start day <= day <= end day */
+        if (memcmp(date, start_time, DATE_LENGTH) < 0 || memcmp(date, end_time, DATE_LENGTH) > 0)
+            continue;
+        if (files_count == (int) allocated) {
+            allocated *= 2;
+            files = realloc(files, sizeof(char *) * allocated);
+        }
+        path = malloc(strlen(dir) + strlen(de->d_name) + 2);
+        sprintf(path, "%s/%s", dir, de->d_name);
+        files[files_count++] = path;
+    }
+    closedir(d);
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+    const StatEntry *ea = (const StatEntry *) a;
+    const StatEntry *eb = (const StatEntry *) b;
+    int cmp;
+    if (ea->count != eb->count)
+        return ea->count > eb->count ? -1 : 1;
+    if ((cmp = strcmp(ea->key.type, eb->key.type)) != 0)
+        return cmp;
+    if ((cmp = strcmp(ea->key.sqlstate, eb->key.sqlstate)) != 0)
+        return cmp;
+    if ((cmp = strcmp(ea->key.database, eb->key.database)) != 0)
+        return cmp;
+    return strcmp(ea->key.user, eb->key.user);
+}
+
+/* CSV field, quoted when name has delimiters */
+static void
+print_csv_string(const char *str)
+{
+    if (strpbrk(str, ",\"\r\n") == NULL) {
+        fputs(str, stdout);
+        return;
+    }
+    putchar('"');
+    for (; *str; ++str) {
+        if (*str == '"')
+            putchar('"');
+        putchar(*str);
+    }
+    putchar('"');
+}
+
+/* JSON string, names may contain any characters */
+static void
+print_json_string(const char *str)
+{
+    putchar('"');
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            printf("\\u%04x", *str);
+        else
+            putchar(*str);
+    }
+    putchar('"');
+}
+
+static void
+print_errors(StatEntry *entries, size_t count, OutputFormat format)
+{
+    size_t i;
+
+    if (format == OUTPUT_TABLE)
+        printf("%-8s %-8s %-20s %-20s %12s\n", "type", "sqlstate", "database", "username", "count");
+    else if (format == OUTPUT_CSV)
+        printf("type,sqlstate,database,username,count\n");
+    else
+        printf("[");
+    for (i = 0; i < count; ++i) {
+        if (format == OUTPUT_TABLE) {
+            printf("%-8s %-8s %-20s %-20s %12llu\n", entries[i].key.type, entries[i].key.sqlstate,
+                   entries[i].key.database, entries[i].key.user, (unsigned long long) entries[i].count);
+        } else if (format == OUTPUT_CSV) {
+            printf("%s,%s,", entries[i].key.type, entries[i].key.sqlstate);
+            print_csv_string(entries[i].key.database);
+            putchar(',');
+            print_csv_string(entries[i].key.user);
+            printf(",%llu\n", (unsigned long long) entries[i].count);
+        } else {
+            printf("%s\n  {\"type\": ", i == 0 ? "" : ",");
+            print_json_string(entries[i].key.type);
+            printf(", \"sqlstate\": ");
+            print_json_string(entries[i].key.sqlstate);
+            printf(", \"database\": ");
+            print_json_string(entries[i].key.database);
+            printf(", \"username\": ");
+            print_json_string(entries[i].key.user);
+            printf(", \"count\": %llu}", (unsigned long long) entries[i].count);
+        }
+    }
+    if (format == OUTPUT_JSON)
+        printf("%s]\n", count > 0 ? "\n" : "");
+}
+
+static void
+print_totals(const uint64_t *totals, OutputFormat format)
+{
+    int i;
+
+    if (format == OUTPUT_TABLE)
+        printf("%-8s %12s\n", "type", "count");
+    else if (format == OUTPUT_CSV)
+        printf("type,count\n");
+    else
+        printf("{");
+    for (i = 0; i < TOTALS_COUNT; ++i) {
+        if (format == OUTPUT_TABLE)
+            printf("%-8s %12llu\n", totals_names[i], (unsigned long long) totals[i]);
+        else if (format == OUTPUT_CSV)
+            printf("%s,%llu\n", totals_names[i], (unsigned long long) totals[i]);
+        else
+            printf("%s\"%s\": %llu", i == 0 ? "" : ", ", totals_names[i], (unsigned long long) totals[i]);
+    }
+    if (format == OUTPUT_JSON)
+        printf("}\n");
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "usage: %s [-d dir] [-s start] [-e end] [-r errors|totals] [-n top] [-f table|csv|json] [-j threads]\n"
+            "          [-m names]\n"
+            "start and end are \"YYYY-MM-DD[ HH:MM[:SS]]\", start <= time < end\n"
+            "names has \"database,oid,name\" and \"user,oid,name\" lines to show names instead of oids\n",
+            progname);
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *dir = ".";
+    OutputFormat format = OUTPUT_TABLE;
+    int threads_count = 0;
+    long top = 20;
+    Worker *workers;
+    StatTable merged;
+    StatKey key;
+    StatEntry *entries;
+    size_t entries_count = 0;
+    uint64_t totals[TOTALS_COUNT] = {0};
+    uint64_t lines = 0;
+    size_t i;
+    int t;
+    int opt;
+    int failed = 0;
+
+    while ((opt = getopt(argc, argv, "d:s:e:r:n:f:j:m:")) != -1) {
+        switch (opt) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 's':
+                if (parse_time_arg(optarg, start_time) != 0)
+                    usage(argv[0]);
+                break;
+            case 'e':
+                if (parse_time_arg(optarg, end_time) != 0)
+                    usage(argv[0]);
+                break;
+            case 'r':
+                if (strcmp(optarg, "errors") == 0)
+                    report = REPORT_ERRORS;
+                else if (strcmp(optarg, "totals") == 0)
+                    report = REPORT_TOTALS;
+                else
+                    usage(argv[0]);
+                break;
+            case 'n':
+                top = atol(optarg);
+                break;
+            case 'f':
+                if (strcmp(optarg, "table") == 0)
+                    format = OUTPUT_TABLE;
+                else if (strcmp(optarg, "csv") == 0)
+                    format = OUTPUT_CSV;
+                else if (strcmp(optarg, "json") == 0)
+                    format = OUTPUT_JSON;
+                else
+                    usage(argv[0]);
+                break;
+            case 'j':
+                threads_count = atoi(optarg);
+                break;
+            case 'm':
+                load_oid_names(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+
+    find_files(dir, report == REPORT_ERRORS ? "errors" : "stats");
+    if (threads_count <= 0)
+        threads_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads_count > files_count)
+        threads_count = files_count;
+    if (threads_count <= 0)
+        threads_count = 1;
+
+    workers = calloc(threads_count, sizeof(Worker));
+    for (t = 0; t < threads_count; ++t) {
+        table_init(&workers[t].table, 1024);
+        if (pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]) != 0) {
+            fprintf(stderr, "could not create thread\n");
+            return 1;
+        }
+    }
+    table_init(&merged, 1024);
+    for (t = 0; t < threads_count; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        for (i = 0; i < workers[t].table.size; ++i) {
+            if (!workers[t].table.entries[i].used)
+                continue;
+            key = workers[t].table.entries[i].key;
+            map_oid_name(key.database, sizeof(key.database), 0);
+            map_oid_name(key.user, sizeof(key.user), 1);
+            table_add(&merged, &key, workers[t].table.entries[i].count);
+        }
+        for (i = 0; i < TOTALS_COUNT; ++i)
+            totals[i] += workers[t].totals[i];
+        lines += workers[t].lines;
+        failed |= workers[t].failed;
+        free(workers[t].table.entries);
+    }
+
+    if (report == REPORT_TOTALS) {
+        print_totals(totals, format);
+    } else {
+        entries = malloc(sizeof(StatEntry) * (merged.used + 1));
+        for (i = 0; i < merged.size; ++i) {
+            if (merged.entries[i].used)
+                entries[entries_count++] = merged.entries[i];
+        }
+        qsort(entries, entries_count, sizeof(StatEntry), compare_entries);
+        if (top > 0 && entries_count > (size_t) top)
+            entries_count = top;
+        print_errors(entries, entries_count, format);
+        free(entries);
+    }
+    fprintf(stderr, "%llu lines read from %d files\n", (unsigned long long) lines, files_count);
+    free(merged.entries);
+    free(workers);
+    for (t = 0; t < files_count; ++t)
+        free(files[t]);
+    free(files);
+    free(oid_names);
+    return failed ? 1 : 0;
+}